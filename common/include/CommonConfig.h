@@ -52,6 +52,8 @@ enum ninconfigbitpos
 	NIN_CFG_BIT_CC_RUMBLE	= (17),
 	NIN_CFG_BIT_SKIP_IPL	= (18),
 	NIN_CFG_BIT_BBA_EMU		= (19),
+	NIN_CFG_BIT_FAST_READ	= (20),	// Deterministic read timing
+	NIN_CFG_BIT_DTK_CACHE	= (21),	// Keep short DTK loops decoded in MEM2
 
 	// Internal kernel settings.
 	NIN_CFG_BIT_MC_SLOTB	= (31),	// Slot B image is loaded
@@ -81,6 +83,8 @@ enum ninconfig
 	NIN_CFG_CC_RUMBLE	= (1<<NIN_CFG_BIT_CC_RUMBLE),
 	NIN_CFG_SKIP_IPL	= (1<<NIN_CFG_BIT_SKIP_IPL),
 	NIN_CFG_BBA_EMU		= (1<<NIN_CFG_BIT_BBA_EMU),
+	NIN_CFG_FAST_READ	= (1<<NIN_CFG_BIT_FAST_READ),
+	NIN_CFG_DTK_CACHE	= (1<<NIN_CFG_BIT_DTK_CACHE),
 
 	NIN_CFG_MC_SLOTB	= (1<<NIN_CFG_BIT_MC_SLOTB),
 };
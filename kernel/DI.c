@@ -34,6 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "Patch.h"
 #include "Stream.h"
 #include "ReadSpeed.h"
+#include "DITrace.h"
 #include "ISO.h"
 #include "FST.h"
 #include "HID.h"
@@ -51,6 +52,8 @@ extern int dbgprintf( const char *fmt, ...);
 #endif
 
 struct ipcmessage DI_CallbackMsg;
+static struct ipcmessage DI_PrefetchMsg ALIGNED(32);
+static struct ipcmessage DI_StreamMsg ALIGNED(32);
 u32 DI_MessageQueue = 0xFFFFFFFF;
 static u8 *DI_MessageHeap = NULL;
 bool DI_IRQ = false;
@@ -91,11 +94,11 @@ static u8 *NetworkCMDBuffer;
 static u8 *const DIMMMemory = (u8*)0x12B80000;
 
 // Multi-disc filenames.
-static const char disc_filenames[8][16] = {
+static const char disc_filenames[10][16] = {
 	// Disc 1
-	"game.ciso", "game.cso", "game.gcm", "game.iso",
+	"game.ciso", "game.cso", "game.gcm", "game.iso", "game.gcz",
 	// Disc 2
-	"disc2.ciso", "disc2.cso", "disc2.gcm", "disc2.iso"
+	"disc2.ciso", "disc2.cso", "disc2.gcm", "disc2.iso", "disc2.gcz"
 };
 
 // Filename portions for 2-disc mode.
@@ -139,6 +142,63 @@ void DiscReadSync(u32 Buffer, u32 Offset, u32 Length, u32 Mode)
 	DIFinishAsync();
 }
 
+/* Let the DI thread read ahead while the game is busy */
+void DIStartPrefetch(void)
+{
+	if(DI_PrefetchMsg.result != 0 || WaitForRealDisc != 0 || FSTMode)
+		return;
+	if(RealDiscCMD ? !RealDI_PrefetchPending() : !ISOPrefetchPending())
+		return;
+	/* Game reads queue up behind it, ReadSpeed timing is not affected */
+	DI_PrefetchMsg.result = -1;
+	sync_after_write(&DI_PrefetchMsg, 0x20);
+	IOS_IoctlAsync( DI_Handle, 3, NULL, 0, NULL, 0, DI_MessageQueue, &DI_PrefetchMsg );
+}
+
+void DIFinishPrefetch(void)
+{
+	while(DI_PrefetchMsg.result != 0)
+		udelay(200); //wait for driver
+}
+
+/* Read audio stream data in the background, game reads queue up behind it */
+void DIStartStreamRead(u32 Buffer, u32 Offset, u32 Length)
+{
+	DIFinishStreamRead(); //if something is still running
+	DI_StreamMsg.result = -1;
+	sync_after_write(&DI_StreamMsg, 0x20);
+	IOS_IoctlAsync( DI_Handle, 1, (void*)Offset, 0, (void*)Buffer, Length, DI_MessageQueue, &DI_StreamMsg );
+}
+
+bool DIStreamReadDone(void)
+{
+	if(RealDiscCMD)
+		RealDI_Update();
+	return (DI_StreamMsg.result == 0);
+}
+
+void DIFinishStreamRead(void)
+{
+	while(DIStreamReadDone() == false)
+		udelay(200); //wait for driver
+}
+
+/* Read a random USB sector in the background, like a prefetch */
+bool DIStartKeepAlive(void)
+{
+	if(DI_PrefetchMsg.result != 0)
+		return false;
+	DI_PrefetchMsg.result = -1;
+	sync_after_write(&DI_PrefetchMsg, 0x20);
+	IOS_IoctlAsync( DI_Handle, 2, NULL, 0, NULL, 0, DI_MessageQueue, &DI_PrefetchMsg );
+	return true;
+}
+
+bool DIIsIdle(void)
+{
+	return DI_CallbackMsg.result == 0 && DI_PrefetchMsg.result == 0 && DI_StreamMsg.result == 0;
+}
+
 //ISO Cache is disabled while SegaBoot runs
 static u8 *const SegaBoot = (u8*)0x12A80000;
 void ReadSegaBoot(u32 Buffer, u32 Offset, u32 Length)
@@ -192,24 +252,24 @@ void DIinit( bool FirstTime )
 			const char **DI_2disc_otherdisc = NULL;
 			DI_2disc_filenames[0] = NULL;
 			DI_2disc_filenames[1] = NULL;
-			for (i = 0; i < 8; i++)
+			for (i = 0; i < 10; i++)
 			{
 				if (!strcasecmp(TempDiscName+slash_pos, disc_filenames[i]))
 				{
 					// Filename is either:
-					// -  game.(ciso|cso|gcm|iso) (Disc 1)
-					// - disc2.(ciso|cso|gcm|iso) (Disc 2)
-					const int discIdx = i / 4;	// either 0 or 1
+					// -  game.(ciso|cso|gcm|iso|gcz) (Disc 1)
+					// - disc2.(ciso|cso|gcm|iso|gcz) (Disc 2)
+					const int discIdx = i / 5;	// either 0 or 1
 					DI_2disc_filenames[discIdx] = disc_filenames[i];
 
 					// Set variables to check for the other disc.
 					if (discIdx == 0) {
-						checkIdxMin = 4;
-						checkIdxMax = 7;
+						checkIdxMin = 5;
+						checkIdxMax = 9;
 						DI_2disc_otherdisc = &DI_2disc_filenames[1];
 					} else {
 						checkIdxMin = 0;
-						checkIdxMax = 3;
+						checkIdxMax = 4;
 						DI_2disc_otherdisc = &DI_2disc_filenames[0];
 					}
 					break;
@@ -268,6 +328,32 @@ void DISetDIMMVersion( u32 Version )
 {
 	write32((u32)DIMMMemory, Version);
 }
+/**
+ * Get the image path of the disc that is not inserted.
+ * @return Path of the other disc, or NULL if this is a single-disc game.
+ */
+static const char *DIGetOtherDisc(void)
+{
+	static char OtherDisc[256];
+	u32 slash_pos;
+
+	if (!DI_2disc_filenames[0] || !DI_2disc_filenames[1])
+		return NULL;
+
+	strcpy(OtherDisc, ConfigGetGamePath());
+	//search the string backwards for '/'
+	for (slash_pos = strlen(OtherDisc); slash_pos > 0; --slash_pos)
+	{
+		if (OtherDisc[slash_pos] == '/')
+			break;
+	}
+	slash_pos++;
+
+	u32 OtherNumber = strcasecmp(OtherDisc+slash_pos, DI_2disc_filenames[0]) == 0 ? 1 : 0;
+	_sprintf(OtherDisc+slash_pos, DI_2disc_filenames[OtherNumber]);
+	return OtherDisc;
+}
+
 bool DIChangeDisc( u32 DiscNumber )
 {
 	if(wiiVCInternal)
@@ -301,6 +387,9 @@ bool DIChangeDisc( u32 DiscNumber )
 		dbgprintf("New Gamepath:\"%s\"\r\n", DiscName );
 	}
 	DIinit(false);
+	// ISOInit dropped the cache, set it up again like the patcher did
+	if(TRIGame != TRI_SB && TITLE_ID != 0x474645)
+		ISOSetupCache();
 	return true;
 }
 
@@ -491,6 +580,7 @@ void DIUpdateRegisters( void )
 				switch( (read32(DI_CMD_0) >> 16) & 0xFF )
 				{
 					case 0x00:
+						DITrace_Record(0xE1, read32(DI_CMD_1) << 2, read32(DI_CMD_2));
 						StreamStartStream(read32(DI_CMD_1) << 2, read32(DI_CMD_2));
 						Streaming = 1;
 						break;
@@ -758,6 +848,7 @@ void DIUpdateRegisters( void )
 							ReadSegaBoot(Buffer, Offset, Length);
 						else
 						{
+							DITrace_Record(0xA8, Offset, Length);
 							DiscReadAsync(Buffer, Offset, Length, 0);
 							ReadSpeed_Start();
 						}
@@ -778,7 +869,10 @@ void DIUpdateRegisters( void )
 					if( useipltri )
 						ReadSegaBoot(Buffer, Offset, Length);
 					else
+					{
+						DITrace_Record(0xF8, Offset, Length);
 						DiscReadSync(Buffer, Offset, Length, 0);
+					}
 				}
 				DIOK = 1;
 			} break;
@@ -836,6 +930,8 @@ u32 DIReadThread(void *arg)
 							Shutdown();
 						}
 					}
+					else //get the other disc ready in the background
+						ISOSetStandby( DIGetOtherDisc() );
 				}
 				mqueue_ack( di_msg, 24 );
 				break;
@@ -858,6 +954,15 @@ u32 DIReadThread(void *arg)
 					mqueue_ack( di_msg, 0 );
 					break;
 				}
+				if(di_msg->ioctl.command == 3)
+				{
+					if( RealDiscCMD )
+						RealDI_Prefetch();
+					else
+						ISOPrefetch();
+					mqueue_ack( di_msg, 0 );
+					break;
+				}
 				di_src = 0;
 				di_dest = (char*)di_msg->ioctl.buffer_io;
 				di_length = di_msg->ioctl.length_io;
@@ -868,11 +973,17 @@ u32 DIReadThread(void *arg)
 				{
 					// NOTE: ISOShift64 is applied in the RealDI and ISO readers.
 					// Not supported for FST.
+					// FST mode reads go through the ISO data cache as well.
 					Length = di_length - Offset;
 					if( RealDiscCMD )
 						di_src = ReadRealDisc(&Length, di_offset + Offset, true);
-					else if( FSTMode )
-						di_src = FSTRead(GamePath, &Length, di_offset + Offset);
+					else if( ISOReadTo((u8*)di_dest + Offset, &Length, di_offset + Offset) )
+					{
+						// Large read, already in place
+						if(((u32)di_dest + Offset) <= 0x31A0 && ((u32)di_dest + Offset + Length) > 0x31A0)
+							Patch31A0Backup = read32(0x31A0);
+						continue;
+					}
 					else
 						di_src = ISORead(&Length, di_offset + Offset);
 					// Copy data at a later point to prevent MEM1 issues
@@ -881,12 +992,17 @@ u32 DIReadThread(void *arg)
 						u32 pos31A0 = 0x31A0 - ((u32)di_dest + Offset);
 						Patch31A0Backup = read32((u32)di_src + pos31A0);
 					}
-					memcpy( di_dest + Offset, di_src, Length > di_length ? di_length : Length );
+					// Readers may return less or more than asked for
+					if( Length > di_length - Offset )
+						Length = di_length - Offset;
+					memcpy( di_dest + Offset, di_src, Length );
 				}
 				if(di_msg->ioctl.command == 0)
 				{
 					DoPatches(di_dest, di_length, di_offset);
 					ReadSpeed_Setup(di_offset, di_length);
+					if( RealDiscCMD == 0 && FSTMode == 0 )
+						ISOPrefetchNote(di_offset, di_length);
 				}
 				sync_after_write( di_dest, di_length );
 				mqueue_ack( di_msg, 0 );
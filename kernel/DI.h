@@ -63,6 +63,13 @@ void DIFinishAsync(void);
 u32 DIReadThread(void *arg);
 bool DiscCheckAsync( void );
 void DiscReadSync(u32 Buffer, u32 Offset, u32 Length, u32 Mode);
+void DIStartPrefetch(void);
+void DIFinishPrefetch(void);
+bool DIStartKeepAlive(void);
+void DIStartStreamRead(u32 Buffer, u32 Offset, u32 Length);
+bool DIStreamReadDone(void);
+void DIFinishStreamRead(void);
+bool DIIsIdle(void);
 void DISetDIMMVersion( u32 Version );
 bool DIChangeDisc( u32 DiscNumber );
 void DIUpdateRegisters( void );
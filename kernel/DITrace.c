@@ -0,0 +1,222 @@
+// Nintendont (kernel): DI read trace recording.
+// Reads are recorded by DI.c and saved to /saves/<ID6>.trace on exit.
+// The trace from the previous session drives the ISO cache preload.
+
+#include "DITrace.h"
+#include "Config.h"
+#include "debug.h"
+#include "string.h"
+#include "ff_utf8.h"
+
+extern u32 DiscRequested;
+
+// Recording ring, first half of the trace area.
+static DITraceRecord *const TraceRing = (DITraceRecord*)DITRACE_AREA;
+// Preload list, second half.
+static DITracePreload *const PreloadList =
+	(DITracePreload*)(DITRACE_AREA + DITRACE_RECORDS_MAX * sizeof(DITraceRecord));
+
+static bool Recording = false;
+static u32 TraceStart;
+static u32 TracePos;	// next ring slot
+static u32 TraceCount;	// records in the ring
+static u32 TraceDropped;
+
+static u32 PreloadCount = 0;
+static u32 PreloadDisc;
+static char TracePath[32];
+
+/**
+ * Compare two preload entries by disc offset.
+ * @return True if a goes after b.
+ */
+static inline bool PreloadAfterByOffset(const DITracePreload *a, const DITracePreload *b)
+{
+	if (a->Offset != b->Offset)
+		return a->Offset > b->Offset;
+	if (a->Length != b->Length)
+		return a->Length > b->Length;
+	return a->Time > b->Time;
+}
+
+/**
+ * Compare two preload entries by heat.
+ * @return True if a goes after b.
+ */
+static inline bool PreloadAfterByHeat(const DITracePreload *a, const DITracePreload *b)
+{
+	if (a->Count != b->Count)
+		return a->Count < b->Count;
+	return a->Time > b->Time;
+}
+
+/**
+ * Shell sort the preload list.
+ * @param ByHeat True to sort hottest first; false to sort by offset.
+ */
+static void PreloadSort(bool ByHeat)
+{
+	static const u16 gaps[] = {1750, 701, 301, 132, 57, 23, 10, 4, 1};
+	u32 g, i, j;
+	for (g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++)
+	{
+		const u32 gap = gaps[g];
+		for (i = gap; i < PreloadCount; i++)
+		{
+			const DITracePreload tmp = PreloadList[i];
+			for (j = i; j >= gap; j -= gap)
+			{
+				const DITracePreload *prev = &PreloadList[j - gap];
+				if (ByHeat ? !PreloadAfterByHeat(prev, &tmp) : !PreloadAfterByOffset(prev, &tmp))
+					break;
+				PreloadList[j] = *prev;
+			}
+			PreloadList[j] = tmp;
+		}
+	}
+}
+
+/**
+ * Build the preload list from the previous trace.
+ * Records are read straight into the list and merged in place.
+ */
+static void PreloadLoad(void)
+{
+	FIL fd;
+	UINT read;
+	DITraceHeader hdr;
+	u32 i, n;
+
+	PreloadCount = 0;
+	if (f_open_char(&fd, TracePath, FA_READ|FA_OPEN_EXISTING) != FR_OK)
+		return;
+
+	f_read(&fd, &hdr, sizeof(hdr), &read);
+	if (read != sizeof(hdr) || hdr.Magic != DITRACE_MAGIC || hdr.Version != DITRACE_VERSION)
+	{
+		f_close(&fd);
+		return;
+	}
+	if (hdr.Count > DITRACE_RECORDS_MAX)
+		hdr.Count = DITRACE_RECORDS_MAX;
+
+	f_read(&fd, PreloadList, hdr.Count * sizeof(DITraceRecord), &read);
+	f_close(&fd);
+	sync_before_read(PreloadList, hdr.Count * sizeof(DITraceRecord));
+	hdr.Count = read / sizeof(DITraceRecord);
+
+	// Keep game reads of this disc. Records and preload
+	// entries are the same size, so convert in place.
+	for (i = 0, n = 0; i < hdr.Count; i++)
+	{
+		const DITraceRecord rec = ((DITraceRecord*)PreloadList)[i];
+		const u32 cmd = rec.Command & 0xFF;
+		if ((cmd != 0xA8 && cmd != 0xF8) || ((rec.Command >> 8) & 0xFF) != PreloadDisc || rec.Length == 0)
+			continue;
+		PreloadList[n].Offset = rec.Offset;
+		PreloadList[n].Length = rec.Length;
+		PreloadList[n].Count = 1;
+		PreloadList[n].Time = rec.Time;
+		n++;
+	}
+	PreloadCount = n;
+
+	// Merge repeated reads.
+	PreloadSort(false);
+	for (i = 1, n = PreloadCount ? 1 : 0; i < PreloadCount; i++)
+	{
+		DITracePreload *last = &PreloadList[n - 1];
+		if (PreloadList[i].Offset == last->Offset && PreloadList[i].Length == last->Length)
+			last->Count++;
+		else
+			PreloadList[n++] = PreloadList[i];
+	}
+	PreloadCount = n;
+	PreloadSort(true);
+
+	dbgprintf("DITrace:Loaded %u reads, %u to preload\r\n", hdr.Count, PreloadCount);
+}
+
+void DITrace_Init(void)
+{
+	char id6[6];
+	sync_before_read((void*)0x0, 0x20);
+	memcpy(id6, (void*)0x0, sizeof(id6));
+	_sprintf(TracePath, "/saves/%.6s.trace", id6);
+
+	Recording = false;
+	TraceStart = read32(HW_TIMER);
+	TracePos = 0;
+	TraceCount = 0;
+	TraceDropped = 0;
+
+	PreloadDisc = DiscRequested;
+	PreloadLoad();
+
+	if (ConfigGetConfig(NIN_CFG_LOG))
+		Recording = true;
+}
+
+bool DITrace_Active(void)
+{
+	return Recording || PreloadCount > 0;
+}
+
+void DITrace_Record(u32 Command, u32 Offset, u32 Length)
+{
+	if (!Recording)
+		return;
+
+	DITraceRecord *rec = &TraceRing[TracePos];
+	rec->Offset = Offset;
+	rec->Length = Length;
+	rec->Time = read32(HW_TIMER) - TraceStart;
+	rec->Command = (Command & 0xFF) | ((DiscRequested & 0xFF) << 8);
+
+	if (++TracePos == DITRACE_RECORDS_MAX)
+		TracePos = 0;
+	if (TraceCount < DITRACE_RECORDS_MAX)
+		TraceCount++;
+	else
+		TraceDropped++;
+}
+
+void DITrace_Save(void)
+{
+	if (!Recording || TraceCount == 0)
+		return;
+
+	FIL fd;
+	UINT wrote;
+	f_mkdir_char("/saves");
+	if (f_open_char(&fd, TracePath, FA_WRITE|FA_CREATE_ALWAYS) != FR_OK)
+	{
+		dbgprintf("DITrace:Unable to create %s\r\n", TracePath);
+		return;
+	}
+
+	DITraceHeader hdr;
+	hdr.Magic = DITRACE_MAGIC;
+	hdr.Version = DITRACE_VERSION;
+	hdr.Count = TraceCount;
+	hdr.Dropped = TraceDropped;
+	f_write(&fd, &hdr, sizeof(hdr), &wrote);
+
+	// Oldest record first.
+	sync_after_write(TraceRing, DITRACE_RECORDS_MAX * sizeof(DITraceRecord));
+	if (TraceCount == DITRACE_RECORDS_MAX)
+		f_write(&fd, &TraceRing[TracePos], (DITRACE_RECORDS_MAX - TracePos) * sizeof(DITraceRecord), &wrote);
+	f_write(&fd, TraceRing, TracePos * sizeof(DITraceRecord), &wrote);
+	f_close(&fd);
+
+	dbgprintf("DITrace:Saved %u reads to %s\r\n", TraceCount, TracePath);
+	Recording = false;
+}
+
+const DITracePreload *DITrace_GetPreload(u32 *Count)
+{
+	if (PreloadCount == 0 || DiscRequested != PreloadDisc)
+		return NULL;
+	*Count = PreloadCount;
+	return PreloadList;
+}
@@ -0,0 +1,80 @@
+// Nintendont (kernel): DI read trace recording.
+// Reads are recorded by DI.c and saved to /saves/<ID6>.trace on exit.
+// The trace from the previous session drives the ISO cache preload.
+
+#ifndef __DITRACE_H__
+#define __DITRACE_H__
+
+#include "global.h"
+
+// Trace ring and preload list, right below the Triforce buffer.
+#define DITRACE_RECORDS_MAX	8192
+#define DITRACE_AREA_SIZE	0x40000
+#define DITRACE_AREA		((u8*)0x12B80000 - DITRACE_AREA_SIZE)
+
+#define DITRACE_MAGIC		0x44495452	/* "DITR" */
+#define DITRACE_VERSION		1
+
+// Trace file header.
+typedef struct _DITraceHeader
+{
+	u32 Magic;	// "DITR"
+	u32 Version;
+	u32 Count;	// number of records
+	u32 Dropped;	// records lost to ring wrap-around
+} DITraceHeader;
+
+// Trace file record.
+typedef struct _DITraceRecord
+{
+	u32 Offset;	// disc offset
+	u32 Length;
+	u32 Time;	// HW_TIMER ticks since the trace started
+	u32 Command;	// DI command byte; disc number in bits 8-15
+} DITraceRecord;
+
+// Preload list entry.
+typedef struct _DITracePreload
+{
+	u32 Offset;
+	u32 Length;
+	u32 Count;	// how often this exact read was seen
+	u32 Time;	// when it was first seen
+} DITracePreload;
+
+/**
+ * Load the previous trace and start recording.
+ * Recording is enabled along with logging (NIN_CFG_LOG).
+ * Must be called after the disc header is in low memory.
+ */
+void DITrace_Init(void);
+
+/**
+ * Is the trace area in use?
+ * If it is, the ISO cache must stay out of it.
+ * @return True if recording or preloading; false if not.
+ */
+bool DITrace_Active(void);
+
+/**
+ * Record a DI read.
+ * @param Command DI command byte.
+ * @param Offset Disc offset.
+ * @param Length Data length.
+ */
+void DITrace_Record(u32 Command, u32 Offset, u32 Length);
+
+/**
+ * Write the recorded trace to /saves/<ID6>.trace.
+ */
+void DITrace_Save(void);
+
+/**
+ * Get the preload list built from the previous trace.
+ * Sorted hottest first.
+ * @param Count [out] Number of entries.
+ * @return Preload list, or NULL if there is none for the current disc.
+ */
+const DITracePreload *DITrace_GetPreload(u32 *Count);
+
+#endif /* __DITRACE_H__ */
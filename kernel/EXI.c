@@ -298,7 +298,7 @@ static void EXIDeviceMemoryCard(int slot, u8 *Data, u32 Length, u32 Mode)
 #ifdef DEBUG_EXI
 						dbgprintf("EXI: Slot %c: CARDErasePage(%08X)\r\n", (slot+'A'), GCNCard_GetBlockOffset(slot));
 #endif
-						// FIXME: ERASE command isn't implemented.
+						GCNCard_Erase(slot);
 						EXICommand[slot] = MEM_BLOCK_ERASE;
 						GCNCard_ClearWriteCount(slot);
 						IRQ_Cause[slot] = 2;	// EXI IRQ
@@ -319,7 +319,7 @@ static void EXIDeviceMemoryCard(int slot, u8 *Data, u32 Length, u32 Mode)
 #ifdef DEBUG_EXI
 						dbgprintf("EXI: Slot %c: CARDErasePage(%08X)\r\n", (slot+'A'), GCNCard_GetBlockOffset(slot));
 #endif
-						// FIXME: ERASE command isn't implemented.
+						GCNCard_Erase(slot);
 						EXICommand[slot] = MEM_BLOCK_ERASE;
 						GCNCard_ClearWriteCount(slot);
 						IRQ_Cause[slot] = 2;	// EXI IRQ
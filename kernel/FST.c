@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "vsprintf.h"
 #include "Config.h"
 #include "DI.h"
+#include "DITrace.h"
 
 #ifndef DEBUG_FST
 #define dbgprintf(...)
@@ -65,19 +66,72 @@ typedef struct
 {
 	u32 Offset;
 	u32 Size;
+	u32 Used;	// LRU stamp
 	FIL File;
+#if _USE_FASTSEEK
+	DWORD LinkMap[FST_LINKMAP_SIZE];
+#endif
 } FileCache;
 
+// Files in sys/, kept open once read.
+enum
+{
+	FST_SYS_BOOT = 0,
+	FST_SYS_BI2,
+	FST_SYS_APPLOADER,
+	FST_SYS_DOL,
+	FST_SYS_FST,
+
+	FST_SYS_MAX
+};
+static const char *const FSTSysName[FST_SYS_MAX] =
+{
+	"boot.bin", "bi2.bin", "apploader.img", "main.dol", "fst.bin"
+};
+
+typedef struct
+{
+	u32 Offset;	// disc offset of the file data
+	u32 Entry;	// FST entry of the file
+	u32 Dir;	// FST entry of its directory, 0 for the root
+} FSTIndexEntry;
+
+// Files sorted by disc offset, built once the apploader has loaded
+// the FST. Sits below the DI trace area, where ISO mode would keep
+// the GCZ buffers.
+#define FST_INDEX_AREA_END	DITRACE_AREA
+#define FST_PATH_DEPTH_MAX	32
+
 #include "ff_utf8.h"
 static u8 *FSTable ALIGNED(32);
 static u32 dolOffset = 0;
 static u32 FSTableSize = 0;
 static u32 FSTableOffset = 0;
 
-static u32 FCEntry = 0;
+static u32 FCStamp = 0;
 static FileCache *FC;
 static u32 FCState[FILECACHE_MAX];
 
+static FileCache SysFC[FST_SYS_MAX];
+static u32 SysOpen = 0;	// bit per FST_SYS_* file
+
+static FSTIndexEntry *FSTIndex = NULL;
+static u32 FSTIndexCount = 0;
+
+static char FSTGamePath[256];
+
+/**
+ * Read a value from a sys/ file header.
+ * Done bytewise so it works on either host byte order.
+ * @param ptr Value.
+ * @return Value in host byte order.
+ */
+static inline u32 FSTReadBE32(const void *ptr)
+{
+	const u8 *p = (const u8*)ptr;
+	return ((u32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
 u32 FSTInit( const char *GamePath )
 {
 	char Path[256];
@@ -85,7 +139,12 @@ u32 FSTInit( const char *GamePath )
 	FIL fd;
 	u32 read;
 
+	//Drop handles from a previous disc
+	if( FSTMode )
+		FSTCleanup();
+
 	FSTable = NULL;
+	_sprintf( FSTGamePath, "%s", GamePath );
 	
 	_sprintf( Path, "%ssys/boot.bin", GamePath );
 	if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
@@ -119,9 +178,9 @@ u32 FSTInit( const char *GamePath )
 			return 0;
 		}
 
-		dolOffset	= buf[0];
-		FSTableOffset	= buf[1];
-		FSTableSize	= buf[2];
+		dolOffset	= FSTReadBE32( &buf[0] );
+		FSTableOffset	= FSTReadBE32( &buf[1] );
+		FSTableSize	= FSTReadBE32( &buf[2] );
 
 		dbgprintf( "DIP:FSTableOffset:%08X\r\n", FSTableOffset );
 		dbgprintf( "DIP:FSTableSize:  %08X\r\n", FSTableSize );
@@ -150,7 +209,7 @@ u32 FSTInit( const char *GamePath )
 		}
 
 		// BI2.bin region code.
-		BI2region = buf[6];
+		BI2region = FSTReadBE32( &buf[6] );
 	}
 
 	//Init cache
@@ -159,226 +218,388 @@ u32 FSTInit( const char *GamePath )
 	{
 		FCState[count] = 0xdeadbeef;
 	}
+	FCStamp = 0;
 
 	return 1;
 }
 void FSTCleanup()
 {
+	u32 i;
+	if( FC != NULL )
+	{
+		for( i=0; i < FILECACHE_MAX; ++i )
+		{
+			if( FCState[i] != 0xdeadbeef )
+				f_close( &(FC[i].File) );
+			FCState[i] = 0xdeadbeef;
+		}
+	}
+	for( i=0; i < FST_SYS_MAX; ++i )
+	{
+		if( SysOpen & (1 << i) )
+			f_close( &(SysFC[i].File) );
+	}
+	SysOpen = 0;
+
 	free(FC);
 	FC = NULL;
 	FSTMode = 0;
 	FSTable = NULL;
+	FSTIndex = NULL;
+	FSTIndexCount = 0;
 }
-const u8* FSTRead(const char *GamePath, u32* Length, u32 Offset)
+
+/**
+ * Open a file for reading and set up its fast-seek map.
+ * @param fc File cache entry.
+ * @param Path File path.
+ * @return FR_OK on success; FatFS error on failure.
+ */
+static FRESULT FSTOpen(FileCache *fc, const char *Path)
 {
-	if (*Length > DI_READ_BUFFER_LENGTH)
-		*Length = DI_READ_BUFFER_LENGTH;
-	char Path[256];
-	FIL fd;
-	u32 read;
-	int i,j;
-	
-	if( Offset >= FSTableOffset+FSTableSize ) {	
-		//Get FSTTable offset from low memory, must be set by apploader
-		if( FSTable == NULL )
-		{
-			FSTable	= (u8*)((*(vu32*)0x38) & 0x7FFFFFFF);
-			//dbgprintf("DIP:FSTOffset:  %08X\r\n", (u32)FSTable );
-		}
+	FRESULT ret = f_open_char( &(fc->File), Path, FA_READ );
+	if( ret != FR_OK )
+		return ret;
+#if _USE_FASTSEEK
+	fc->LinkMap[0] = FST_LINKMAP_SIZE;
+	fc->File.cltbl = fc->LinkMap;
+	if( f_lseek( &(fc->File), CREATE_LINKMAP ) != FR_OK )
+		fc->File.cltbl = NULL;	//too fragmented, follow the FAT
+#endif
+	return FR_OK;
+}
 
-		//try cache first!
-		for( i=0; i < FILECACHE_MAX; ++i )
+/**
+ * Read from a sys/ file, opening it on first use.
+ * @param Buffer Output buffer.
+ * @param Sys FST_SYS_* file.
+ * @param Offset Offset in the file.
+ * @param Length Length to read.
+ * @return Bytes read.
+ */
+static u32 FSTReadSys(u8 *Buffer, u32 Sys, u32 Offset, u32 Length)
+{
+	u32 read = 0;
+
+	if( !(SysOpen & (1 << Sys)) )
+	{
+		char Path[256];
+		_sprintf( Path, "%ssys/%s", FSTGamePath, FSTSysName[Sys] );
+		if( FSTOpen( &SysFC[Sys], Path ) != FR_OK )
 		{
-			if( FCState[i] == 0xdeadbeef )
-				continue;
-
-			if( Offset >= FC[i].Offset )
-			{
-				u64 nOffset = Offset - FC[i].Offset;
-				if( nOffset < FC[i].Size )
-				{
-					//dbgprintf("DIP:[Cache:%02d][%08X:%05X]\r\n", i, (u32)(nOffset>>2), Length );
-					f_lseek( &(FC[i].File), nOffset );
-					f_read( &(FC[i].File), DI_READ_BUFFER, ((*Length)+31)&(~31), &read );
-					return DI_READ_BUFFER;
-				}
-			}
+			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
+			return 0;
 		}
+		SysOpen |= 1 << Sys;
+	}
 
-		//The fun part!
+	//dbgprintf( "DIP:[%s] Offset:%08X Size:%08X\r\n", FSTSysName[Sys], Offset, Length );
+	f_lseek( &(SysFC[Sys].File), Offset );
+	f_read( &(SysFC[Sys].File), Buffer, Length, &read );
+	return read;
+}
+
+/**
+ * Parent of an FST directory entry.
+ * @param fe FST.
+ * @param Dir Directory entry.
+ * @return Parent directory entry; 0 for the root or a bad link.
+ */
+static inline u32 FSTParent(const FEntry *fe, u32 Dir)
+{
+	return fe[Dir].ParentOffset < Dir ? fe[Dir].ParentOffset : 0;
+}
 
-		u32 Entries = *(u32*)(FSTable+0x08);
-		char *NameOff = (char*)(FSTable + Entries * 0x0C);
-		FEntry *fe = (FEntry*)(FSTable);
+/**
+ * Build the offset-sorted file index from the FST at FSTable.
+ */
+static void FSTBuildIndex(void)
+{
+	const FEntry *fe = (const FEntry*)FSTable;
+	FSTIndexEntry tmp;
+	u32 Entries, Files = 0, Dir = 0;
+	u32 i, j, gap;
+
+	sync_before_read_align32( FSTable, FSTableSize );
+	Entries = fe[0].NextOffset;
+	FSTIndexCount = 0;
 
-		u32 Entry[16];
-		u32 LEntry[16];
-		u32 level=0;
+	//the root entry holds the entry count, it has to fit the FST in boot.bin
+	if( Entries == 0 || Entries > FSTableSize / 0x0C )
+	{
+		dbgprintf("DIP:FST has a bad entry count:%u\r\n", Entries );
+		return;
+	}
 
-		for( i=1; i < Entries; ++i )
+	for( i=1; i < Entries; ++i )
+	{
+		if( !fe[i].Type && fe[i].FileLength )
+			Files++;
+	}
+	FSTIndex = (FSTIndexEntry*)(FST_INDEX_AREA_END - ALIGN_FORWARD(Files * sizeof(FSTIndexEntry), 0x20));
+
+	//Directories contain everything up to their NextOffset
+	for( i=1; i < Entries; ++i )
+	{
+		while( Dir && i >= fe[Dir].NextOffset )
+			Dir = FSTParent(fe, Dir);
+
+		if( fe[i].Type )
+			Dir = i;
+		else if( fe[i].FileLength )
 		{
-			if( level )
-			{
-				while( LEntry[level-1] == i )
-				{
-					//printf("[%03X]leaving :\"%s\" Level:%d\r\n", i, buffer + NameOff + swap24( fe[Entry[level-1]].NameOffset ), level );
-					level--;
-				}
-			}
-
-			if( fe[i].Type )
-			{
-				//Skip empty folders
-				if( fe[i].NextOffset == i+1 )
-					continue;
-
-				//printf("[%03X]Entering:\"%s\" Level:%d leave:%04X\r\n", i, buffer + NameOff + swap24( fe[i].NameOffset ), level, swap32( fe[i].NextOffset ) );
-				Entry[level] = i;
-				LEntry[level++] = fe[i].NextOffset;
-				if( level > 15 )  // something is wrong!
-					break;
-			} else {
-				if( Offset >= fe[i].FileOffset )
-				{
-					u32 nOffset = (Offset - fe[i].FileOffset);
-					if( nOffset < fe[i].FileLength )
-					{
-						//dbgprintf("DIP:Offset:%08X FOffset:%08X Dif:%08X Flen:%08X nOffset:%08X\r\n", Offset, fe[i].FileOffset, Offset-fe[i].FileOffset, fe[i].FileLength, nOffset );
-
-						//Do not remove!
-						memset32( Path, 0, 256 );					
-						_sprintf( Path, "%sroot/", GamePath );
-
-						for( j=0; j<level; ++j )
-						{
-							if( j )
-								Path[strlen(Path)] = '/';
-							memcpy( Path+strlen(Path), NameOff + fe[Entry[j]].NameOffset, strlen(NameOff + fe[Entry[j]].NameOffset ) );
-						}
-						if( level )
-							Path[strlen(Path)] = '/';
-						memcpy( Path+strlen(Path), NameOff + fe[i].NameOffset, strlen(NameOff + fe[i].NameOffset) );
-						
-						if( FCEntry >= FILECACHE_MAX )
-							FCEntry = 0;
-
-						if( FCState[FCEntry] != 0xdeadbeef )
-						{
-							f_close( &(FC[FCEntry].File) );
-							FCState[FCEntry] = 0xdeadbeef;
-						}
-
-						Asciify( Path );
-
-						//dbgprintf("DIP:[%s]\r\n", Path+strlen(GamePath)+5 );
-
-						f_open_char( &(FC[FCEntry].File), Path, FA_READ );
-
-						FC[FCEntry].Size	= fe[i].FileLength;
-						FC[FCEntry].Offset	= fe[i].FileOffset;
-						FCState[FCEntry]	= 0x23;
-
-						f_lseek( &(FC[FCEntry].File), nOffset );
-						f_read( &(FC[FCEntry].File), DI_READ_BUFFER, *Length, &read );
-
-						FCEntry++;
-					}
-				}
-			}
+			FSTIndex[FSTIndexCount].Offset = fe[i].FileOffset;
+			FSTIndex[FSTIndexCount].Entry = i;
+			FSTIndex[FSTIndexCount].Dir = Dir;
+			FSTIndexCount++;
 		}
+	}
 
-	} else if ( Offset >= FSTableOffset ) {
-		
-		Offset -= FSTableOffset;
-		
-		_sprintf( Path, "%ssys/fst.bin", GamePath );
-		if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
+	//Mastering tools mostly lay files out in FST order, shell sort
+	//is close to linear then and needs no extra memory
+	for( gap = FSTIndexCount / 2; gap > 0; gap /= 2 )
+	{
+		for( i = gap; i < FSTIndexCount; ++i )
 		{
-			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
-			return DI_READ_BUFFER;
-		} else {
-			//dbgprintf( "DIP:[fst.bin] Offset:%08X Size:%08X\r\n", Offset, *Length );
-			
-			f_lseek( &fd, Offset );
-			f_read( &fd, DI_READ_BUFFER, *Length, &read );
-			f_close( &fd );
-
-			return DI_READ_BUFFER;
+			tmp = FSTIndex[i];
+			for( j = i; j >= gap && FSTIndex[j-gap].Offset > tmp.Offset; j -= gap )
+				FSTIndex[j] = FSTIndex[j-gap];
+			FSTIndex[j] = tmp;
 		}
+	}
 
-	} else if ( Offset >= dolOffset ) {
-		
-		Offset -= dolOffset;
-		
-		_sprintf( Path, "%ssys/main.dol", GamePath );
-		if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
-		{
-			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
-			return DI_READ_BUFFER;
-		} else {
-			//dbgprintf( "DIP:[main.dol] Offset:%08X Size:%08X\r\n", Offset, *Length );
-			
-			f_lseek( &fd, Offset );
-			f_read( &fd, DI_READ_BUFFER, *Length, &read );
-			f_close( &fd );
+	dbgprintf("DIP:FST index:%u files at %08X\r\n", FSTIndexCount, (u32)FSTIndex );
+}
 
-			return DI_READ_BUFFER;
-		}
+/**
+ * Find the file containing a disc offset.
+ * @param Offset Disc offset.
+ * @param Next [out] Start of the next file, 0 if there is none.
+ * @return Index entry; NULL if no file contains Offset.
+ */
+static const FSTIndexEntry *FSTFindFile(u32 Offset, u32 *Next)
+{
+	const FEntry *fe = (const FEntry*)FSTable;
+	u32 lo = 0, hi = FSTIndexCount;
 
-	} else if ( Offset >= 0x2440 ) {
-		
-		Offset -= 0x2440;
-		
-		_sprintf( Path, "%ssys/apploader.img", GamePath );
-		if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
-		{
-			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
-			return DI_READ_BUFFER;
-		} else {
-			//dbgprintf( "DIP:[apploader.img] Offset:%08X Size:%08X\r\n", Offset, *Length );
-			
-			f_lseek( &fd, Offset );
-			f_read( &fd, DI_READ_BUFFER, *Length, &read );
-			f_close( &fd );
+	//last file starting at or before Offset
+	while( lo < hi )
+	{
+		u32 mid = (lo + hi) / 2;
+		if( FSTIndex[mid].Offset <= Offset )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*Next = lo < FSTIndexCount ? FSTIndex[lo].Offset : 0;
+	if( lo == 0 )
+		return NULL;
+	if( Offset - FSTIndex[lo-1].Offset >= fe[FSTIndex[lo-1].Entry].FileLength )
+		return NULL;
+	return &FSTIndex[lo-1];
+}
+
+/**
+ * Build the SD/USB path of an FST file from its parent links.
+ * @param Path Output buffer, 256 bytes.
+ * @param fi Index entry of the file.
+ */
+static void FSTGetPath(char *Path, const FSTIndexEntry *fi)
+{
+	const FEntry *fe = (const FEntry*)FSTable;
+	const char *NameOff = (const char*)(FSTable + fe[0].NextOffset * 0x0C);
+	const char *Name;
+	char *End = Path + 255;
+	char *p;
+	u32 Chain[FST_PATH_DEPTH_MAX];
+	u32 depth = 0;
+	u32 Dir = fi->Dir;
+
+	while( Dir && depth < FST_PATH_DEPTH_MAX )
+	{
+		Chain[depth++] = Dir;
+		Dir = FSTParent(fe, Dir);
+	}
+
+	//Do not remove!
+	memset32( Path, 0, 256 );
+	_sprintf( Path, "%sroot/", FSTGamePath );
+	p = Path + strlen(Path);
 
-			return DI_READ_BUFFER;
+	while( depth-- > 0 )
+	{
+		for( Name = NameOff + fe[Chain[depth]].NameOffset; *Name && p < End; )
+			*p++ = *Name++;
+		if( p < End )
+			*p++ = '/';
+	}
+	for( Name = NameOff + fe[fi->Entry].NameOffset; *Name && p < End; )
+		*p++ = *Name++;
+}
+/**
+ * Get an open handle for the file containing a disc offset.
+ * Opens the file into the least recently used slot if needed.
+ * @param Offset Disc offset, past the FST.
+ * @param Next [out] If no file contains Offset: start of the next file, 0 if none.
+ * @return File cache entry; NULL if no file contains Offset.
+ */
+static FileCache *FSTGetFile(u32 Offset, u32 *Next)
+{
+	char Path[256];
+	const FSTIndexEntry *fi;
+	const FEntry *fe;
+	u32 i, FCEntry = 0;
+
+	//try cache first!
+	for( i=0; i < FILECACHE_MAX; ++i )
+	{
+		if( FCState[i] == 0xdeadbeef )
+			continue;
+
+		if( Offset >= FC[i].Offset && Offset - FC[i].Offset < FC[i].Size )
+		{
+			//dbgprintf("DIP:[Cache:%02d][%08X]\r\n", i, Offset - FC[i].Offset );
+			FC[i].Used = ++FCStamp;
+			return &FC[i];
 		}
+	}
 
-	} else if ( Offset >= 0x440 ) {
+	fi = FSTFindFile(Offset, Next);
+	if( fi == NULL )
+		return NULL;
+	fe = (const FEntry*)FSTable;
+
+	FSTGetPath( Path, fi );
 
-		Offset -= 0x440;
-		
-		_sprintf( Path, "%ssys/bi2.bin", GamePath );
-		if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
+	//free slot, or the least recently used one
+	for( i=0; i < FILECACHE_MAX; ++i )
+	{
+		if( FCState[i] == 0xdeadbeef )
 		{
-			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
-			return DI_READ_BUFFER;
-		} else {
-			//dbgprintf( "DIP:[bi2.bin] Offset:%08X Size:%08X\r\n", Offset, *Length );
+			FCEntry = i;
+			break;
+		}
+		if( FC[i].Used < FC[FCEntry].Used )
+			FCEntry = i;
+	}
 
-			f_lseek( &fd, Offset );
-			f_read( &fd, DI_READ_BUFFER, *Length, &read );
-			f_close( &fd );
+	if( FCState[FCEntry] != 0xdeadbeef )
+	{
+		f_close( &(FC[FCEntry].File) );
+		FCState[FCEntry] = 0xdeadbeef;
+	}
+
+	Asciify( Path );
+
+	//dbgprintf("DIP:[%s]\r\n", Path+strlen(FSTGamePath)+5 );
+
+	if( FSTOpen( &FC[FCEntry], Path ) != FR_OK )
+	{
+		dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
+		*Next = 0;
+		return NULL;
+	}
+	FC[FCEntry].Size	= fe[fi->Entry].FileLength;
+	FC[FCEntry].Offset	= fi->Offset;
+	FC[FCEntry].Used	= ++FCStamp;
+	FCState[FCEntry]	= 0x23;
+
+	return &FC[FCEntry];
+}
 
-			return DI_READ_BUFFER;
+/**
+ * Read from the extracted file that contains a disc offset.
+ * @param Buffer Output buffer.
+ * @param Length Data length.
+ * @param Offset Disc offset.
+ * @return Bytes of Buffer filled, at least 1.
+ */
+static u32 FSTReadSegment(u8 *Buffer, u32 Length, u32 Offset)
+{
+	u32 read = 0;
+	u32 End;	//end of the disc range covered by this file
+
+	if( Offset >= FSTableOffset+FSTableSize ) {
+		//Get FSTTable offset from low memory, must be set by apploader
+		if( FSTable == NULL )
+		{
+			FSTable	= (u8*)(read32(0x38) & 0x7FFFFFFF);
+			//dbgprintf("DIP:FSTOffset:  %08X\r\n", (u32)FSTable );
+			FSTBuildIndex();
 		}
 
-	} else {
-		_sprintf( Path, "%ssys/boot.bin", GamePath );
-		if( f_open_char( &fd, Path, FA_READ ) != FR_OK )
+		u32 Next = 0;
+		FileCache *fc = FSTGetFile( Offset, &Next );
+		if( fc != NULL )
 		{
-			dbgprintf( "DIP:[%s] Failed to open!\r\n", Path );
-			return DI_READ_BUFFER;
-		} else {
-			//dbgprintf( "DIP:[boot.bin] Offset:%08X Size:%08X\r\n", Offset, *Length );
-			
-			f_lseek( &fd, Offset );
-			f_read( &fd, DI_READ_BUFFER, *Length, &read );
+			End = fc->Offset + fc->Size;
+			if( Length > End - Offset )
+				Length = End - Offset;
+			f_lseek( &(fc->File), Offset - fc->Offset );
+			f_read( &(fc->File), Buffer, Length, &read );
+		}
+		else if( Next > Offset && Length > Next - Offset )
+			Length = Next - Offset;	//padding up to the next file
 
-			f_close( &fd );
+	} else if ( Offset >= FSTableOffset ) {
+		End = FSTableOffset + FSTableSize;
+		if( Length > End - Offset )
+			Length = End - Offset;
+		read = FSTReadSys( Buffer, FST_SYS_FST, Offset - FSTableOffset, Length );
+	} else if ( Offset >= dolOffset ) {
+		End = FSTableOffset;
+		if( End > Offset && Length > End - Offset )
+			Length = End - Offset;
+		read = FSTReadSys( Buffer, FST_SYS_DOL, Offset - dolOffset, Length );
+	} else if ( Offset >= 0x2440 ) {
+		End = dolOffset;
+		if( Length > End - Offset )
+			Length = End - Offset;
+		read = FSTReadSys( Buffer, FST_SYS_APPLOADER, Offset - 0x2440, Length );
+	} else if ( Offset >= 0x440 ) {
+		End = 0x2440;
+		if( Length > End - Offset )
+			Length = End - Offset;
+		read = FSTReadSys( Buffer, FST_SYS_BI2, Offset - 0x440, Length );
+	} else {
+		End = 0x440;
+		if( Length > End - Offset )
+			Length = End - Offset;
+		read = FSTReadSys( Buffer, FST_SYS_BOOT, Offset, Length );
+	}
 
-			return DI_READ_BUFFER;
-		}
+	//past the end of the file, or between files
+	if( read < Length )
+		memset( Buffer + read, 0, Length - read );
+	return Length;
+}
+
+/**
+ * Read data at a disc offset from the extracted files.
+ * Reads may span several files. Gaps between files read as zero.
+ * @param Buffer Output buffer.
+ * @param Length Data length.
+ * @param Offset Disc offset.
+ */
+void FSTReadDirect(void *Buffer, u32 Length, u32 Offset)
+{
+	u8 *ptr8 = (u8*)Buffer;
+	while( Length > 0 )
+	{
+		u32 Done = FSTReadSegment( ptr8, Length, Offset );
+		ptr8 += Done;
+		Offset += Done;
+		Length -= Done;
 	}
-	return DI_READ_BUFFER;
+}
+
+/**
+ * Start of the MEM2 area reserved for the file index.
+ * The data cache has to end below it.
+ * @return Start of the area.
+ */
+u8 *FSTGetIndexArea(void)
+{
+	//file entries take 12 bytes in the FST as well
+	return FST_INDEX_AREA_END - ALIGN_FORWARD(FSTableSize, 0x20);
 }
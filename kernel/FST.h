@@ -4,11 +4,19 @@
 #include "global.h"
 #include "ff.h"
 
-#define FILECACHE_MAX	2
+// Open file handles kept for extracted FST games, reused LRU.
+#ifndef FILECACHE_MAX
+#define FILECACHE_MAX	8
+#endif
+
+// Fast-seek map size per open file, in DWORDs.
+// Files with more fragments than fit are read through the FAT.
+#define FST_LINKMAP_SIZE	32
 
 u32 FSTInit( const char *GamePath );
 void FSTCleanup( void );
-const u8* FSTRead( const char *GamePath, u32* Length, u32 Offset );
+void FSTReadDirect( void *Buffer, u32 Length, u32 Offset );
+u8 *FSTGetIndexArea( void );
 
 void CacheInit( char *Table, bool ForceReinit );
 void CacheFile( const char *FileName, char *Table );
@@ -12,24 +12,37 @@ extern vu32 TRIGame;
 // Memory Card context.
 static u8 *const GCNCard_base = (u8*)(0x11000000);
 
+// Modified blocks are tracked in 8 KB card blocks.
+#define CARD_BLOCK_SHIFT	13
+#define CARD_BLOCK_SIZE		(1 << CARD_BLOCK_SHIFT)
+#define CARD_SYSTEM_BLOCKS	5	// 0xA000 bytes
+#define CARD_BLOCKS_MAX		(MEM_CARD_SIZE(MEM_CARD_MAX) >> CARD_BLOCK_SHIFT)
+// Most blocks written by one f_write() while flushing.
+#define CARD_FLUSH_BLOCKS	4
+
 typedef struct _GCNCard_ctx {
 	char filename[0x20];    // Memory Card filename.
 	u8 *base;               // Base address.
 	u32 size;               // Size, in bytes.
 	u32 code;               // Memory card "code".
 
-	// BlockOffLow starts from 0xA000; does not include "system" blocks.
+	// The dirty bitmap does not include the "system" blocks.
 	// For system blocks, check 'changed_system'.
 	bool changed;		// True if the card has been modified at all.
 				// (NOTE: Reset after calling GCNCard_CheckChanges().)
 	bool changed_system;	// True if the system area (first 5 blocks)
 				// has been modified. These blocks are NOT
-				// included in BlockOffLow / BlockOffHigh.
+				// included in the dirty bitmap.
+	u32 dirty_count;	// Number of bits set in dirty.
+	u32 dirty[CARD_BLOCKS_MAX / 32];	// Modified blocks, one bit each.
+	// Erased blocks read back as 0xFF, but the buffer is only filled
+	// when they get written, or saved.
+	u32 erased_count;	// Number of bits set in erased.
+	u32 erased[CARD_BLOCKS_MAX / 32];	// Erased blocks, one bit each.
+	u32 flush_block;	// Where the next flush chunk starts looking.
 
 	// NOTE: BlockOff is in bytes, not blocks.
 	u32 BlockOff;           // Current offset.
-	u32 BlockOffLow;        // Low address of last modification.
-	u32 BlockOffHigh;       // High address of last modification.
 	u32 CARDWriteCount;     // Write count. (TODO: Is this used anywhere?)
 } GCNCard_ctx;
 #ifdef GCNCARD_ENABLE_SLOT_B
@@ -40,10 +53,13 @@ static GCNCard_ctx memCard[1] __attribute__((aligned(32)));
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
 
+// Memory card file being flushed, kept open between chunks.
+static FIL flush_fd;
+static int flush_slot = -1;
+
 static void GCNCard_InitCtx(GCNCard_ctx *ctx)
 {
 	memset(ctx, 0, sizeof(*ctx));
-	ctx->BlockOffLow = 0xFFFFFFFF;
 }
 
 /**
@@ -237,9 +253,12 @@ int GCNCard_Load(int slot)
 	f_read(&fd, ctx->base, ctx->size, &read);
 	f_close(&fd);
 
-	// Reset the low/high offsets to indicate that everything was just loaded.
-	ctx->BlockOffLow = 0xFFFFFFFF;
-	ctx->BlockOffHigh = 0x00000000;
+	// Clear the dirty blocks to indicate that everything was just loaded.
+	memset(ctx->dirty, 0, sizeof(ctx->dirty));
+	ctx->dirty_count = 0;
+	ctx->changed_system = false;
+	memset(ctx->erased, 0, sizeof(ctx->erased));
+	ctx->erased_count = 0;
 
 #ifdef DEBUG_EXI
 	dbgprintf("EXI: Loaded Slot %c memory card size %u\r\n", (slot+'A'), ctx->size);
@@ -293,16 +312,144 @@ bool GCNCard_CheckChanges(void)
 }
 
 /**
-* Save the memory card(s).
+ * Mark the blocks covered by a write as modified.
+ * @param ctx Memory card context.
+ * @param offset Offset of the write, in bytes.
+ * @param length Length of the write, in bytes.
+ */
+static void GCNCard_MarkDirty(GCNCard_ctx *ctx, u32 offset, u32 length)
+{
+	u32 block = offset >> CARD_BLOCK_SHIFT;
+	u32 end = (offset + length + CARD_BLOCK_SIZE - 1) >> CARD_BLOCK_SHIFT;
+	if (end > (ctx->size >> CARD_BLOCK_SHIFT))
+		end = ctx->size >> CARD_BLOCK_SHIFT;
+
+	for (; block < end; block++)
+	{
+		if (block < CARD_SYSTEM_BLOCKS)
+		{
+			// System area is saved separately.
+			ctx->changed_system = true;
+			continue;
+		}
+		const u32 bit = 1U << (block & 31);
+		if (!(ctx->dirty[block >> 5] & bit))
+		{
+			ctx->dirty[block >> 5] |= bit;
+			ctx->dirty_count++;
+		}
+	}
+}
+
+static inline bool GCNCard_IsErased(const GCNCard_ctx *ctx, u32 block)
+{
+	return (ctx->erased[block >> 5] & (1U << (block & 31))) != 0;
+}
+
+/**
+ * Fill erased blocks in the card buffer with 0xFF, so they can be
+ * written or saved.
+ * @param ctx Memory card context.
+ * @param offset Offset, in bytes.
+ * @param length Length, in bytes.
+ */
+static void GCNCard_FillErased(GCNCard_ctx *ctx, u32 offset, u32 length)
+{
+	if (ctx->erased_count == 0)
+		return;
+
+	u32 block = offset >> CARD_BLOCK_SHIFT;
+	u32 end = (offset + length + CARD_BLOCK_SIZE - 1) >> CARD_BLOCK_SHIFT;
+	if (end > (ctx->size >> CARD_BLOCK_SHIFT))
+		end = ctx->size >> CARD_BLOCK_SHIFT;
+
+	for (; block < end; block++)
+	{
+		if (!GCNCard_IsErased(ctx, block))
+			continue;
+		u8 *const ptr = &ctx->base[block << CARD_BLOCK_SHIFT];
+		memset(ptr, 0xFF, CARD_BLOCK_SIZE);
+		sync_after_write(ptr, CARD_BLOCK_SIZE);
+		ctx->erased[block >> 5] &= ~(1U << (block & 31));
+		ctx->erased_count--;
+	}
+}
+
+/**
+ * Write the next chunk of a memory card's changes to its file:
+ * the system area, or the next run of modified blocks, at most
+ * CARD_FLUSH_BLOCKS long. Runs are written in card order.
+ * @param ctx Memory card context.
+ * @param fd Open memory card file.
+ */
+static void GCNCard_WriteChunk(GCNCard_ctx *ctx, FIL *fd)
+{
+	const u32 blocks = ctx->size >> CARD_BLOCK_SHIFT;
+	u32 block = ctx->flush_block;
+	UINT wrote;
+
+	if (ctx->changed_system)
+	{
+		// System area is always written as one piece.
+		ctx->changed_system = false;
+		GCNCard_FillErased(ctx, 0, CARD_SYSTEM_BLOCKS << CARD_BLOCK_SHIFT);
+		sync_before_read(ctx->base, CARD_SYSTEM_BLOCKS << CARD_BLOCK_SHIFT);
+		f_lseek(fd, 0);
+		f_write(fd, ctx->base, CARD_SYSTEM_BLOCKS << CARD_BLOCK_SHIFT, &wrote);
+		return;
+	}
+
+	// Find the next modified block.
+	// Blocks modified behind the cursor are found after wrapping around.
+	while (1)
+	{
+		if (block < CARD_SYSTEM_BLOCKS || block >= blocks)
+			block = CARD_SYSTEM_BLOCKS;
+		if (ctx->dirty[block >> 5] == 0)
+		{
+			// Skip 32 clean blocks at once.
+			block = (block | 31) + 1;
+			continue;
+		}
+		if (ctx->dirty[block >> 5] & (1U << (block & 31)))
+			break;
+		block++;
+	}
+
+	// Collect the run of modified blocks.
+	const u32 start = block;
+	do {
+		ctx->dirty[block >> 5] &= ~(1U << (block & 31));
+		ctx->dirty_count--;
+		block++;
+	} while (block < blocks && block - start < CARD_FLUSH_BLOCKS &&
+		 (ctx->dirty[block >> 5] & (1U << (block & 31))));
+	ctx->flush_block = block;
+
+	const u32 offset = start << CARD_BLOCK_SHIFT;
+	const u32 length = (block - start) << CARD_BLOCK_SHIFT;
+	GCNCard_FillErased(ctx, offset, length);
+	sync_before_read(&ctx->base[offset], length);
+	f_lseek(fd, offset);
+	f_write(fd, &ctx->base[offset], length, &wrote);
+}
+
+/**
+* Write back part of the memory card changes.
+* Call again while it returns true; the next call continues
+* where this one stopped.
+* @param budget Time budget, in HW_TIMER ticks. (0 == no limit)
+* @return True if there are more changes to write; false if not.
 */
-void GCNCard_Save(void)
+bool GCNCard_Flush(u32 budget)
 {
 	if (TRIGame)
 	{
 		// Triforce doesn't use the standard EXI CARD interface.
-		return;
+		return false;
 	}
 
+	const u32 start = read32(HW_TIMER);
 	int slot;
 	for (slot = 0; slot < ARRAY_SIZE(memCard); slot++)
 	{
@@ -314,50 +461,64 @@ void GCNCard_Save(void)
 
 		// Does this card have any unsaved changes?
 		GCNCard_ctx *const ctx = &memCard[slot];
-		if (ctx->changed_system ||
-		    ctx->BlockOffLow < ctx->BlockOffHigh)
+		if (!ctx->changed_system && ctx->dirty_count == 0)
 		{
-//#ifdef DEBUG_EXI
-			//dbgprintf("EXI: Saving memory card in Slot %c...", (slot+'A'));
-//#endif
-			FIL fd;
-			int ret = f_open_char(&fd, ctx->filename, FA_WRITE|FA_OPEN_EXISTING);
-			if (ret == FR_OK)
+			if (flush_slot == slot)
 			{
-				UINT wrote;
-				sync_before_read(ctx->base, ctx->size);
-
-				// Save the system area, if necessary.
-				if (ctx->changed_system)
-				{
-					f_lseek(&fd, 0);
-					f_write(&fd, ctx->base, 0xA000, &wrote);
-				}
-
-				// Save the general area, if necessary.
-				if (ctx->BlockOffLow < ctx->BlockOffHigh)
-				{
-					f_lseek(&fd, ctx->BlockOffLow);
-					f_write(&fd, &ctx->base[ctx->BlockOffLow],
-						(ctx->BlockOffHigh - ctx->BlockOffLow), &wrote);
-				}
-
-				f_close(&fd);
-//#ifdef DEBUG_EXI
-				//dbgprintf("Done!\r\n");
-//#endif
+				// Finished by the last call.
+				f_close(&flush_fd);
+				flush_slot = -1;
 			}
-			else
+			continue;
+		}
+
+		if (flush_slot != slot)
+		{
+			if (flush_slot >= 0)
+				f_close(&flush_fd);
+			flush_slot = -1;
+
+			int ret = f_open_char(&flush_fd, ctx->filename, FA_WRITE|FA_OPEN_EXISTING);
+			if (ret != FR_OK)
 			{
 				dbgprintf("\r\nEXI: Unable to open Slot %c memory card file: %u\r\n", (slot+'A'), ret);
+				// Drop the changes; they will not get written.
+				memset(ctx->dirty, 0, sizeof(ctx->dirty));
+				ctx->dirty_count = 0;
+				ctx->changed_system = false;
+				continue;
 			}
+			flush_slot = slot;
+			ctx->flush_block = CARD_SYSTEM_BLOCKS;
+		}
 
-			// Reset the low/high offsets to indicate that everything has been saved.
-			ctx->BlockOffLow = 0xFFFFFFFF;
-			ctx->BlockOffHigh = 0x00000000;
-			ctx->changed_system = false;
+		while (ctx->changed_system || ctx->dirty_count > 0)
+		{
+			GCNCard_WriteChunk(ctx, &flush_fd);
+			if (budget != 0 && TimerDiffTicks(start) >= budget)
+			{
+				// Out of time. Keep the file open for the next call.
+				return true;
+			}
 		}
+
+		// Everything has been saved.
+		f_close(&flush_fd);
+		flush_slot = -1;
+#ifdef DEBUG_EXI
+		dbgprintf("EXI: Slot %c: flushed in %u ticks\r\n", (slot+'A'), TimerDiffTicks(start));
+#endif
 	}
+
+	return false;
+}
+
+/**
+* Save the memory card(s).
+*/
+void GCNCard_Save(void)
+{
+	GCNCard_Flush(0);
 }
 
 /** Functions used by EXIDeviceMemoryCard(). **/
@@ -399,36 +560,10 @@ void GCNCard_Write(int slot, const void *data, u32 length)
 	GCNCard_ctx *const ctx = &memCard[slot];
 	ctx->changed = true;
 
-	// Is this update entirely within the "system area"?
-	if (ctx->BlockOff < 0xA000 && ctx->BlockOff + length < 0xA000)
-	{
-		// This update is entirely within the "system area".
-		// Only set the flag; don't set block offsets.
-		ctx->changed_system = true;
-	}
-	else
-	{
-		// Update the block offsets for saving.
-		if (ctx->BlockOff < ctx->BlockOffLow)
-			ctx->BlockOffLow = ctx->BlockOff;
-		if (ctx->BlockOff + length > ctx->BlockOffHigh)
-			ctx->BlockOffHigh = ctx->BlockOff + length;
-		ctx->changed = true;
-
-		if (ctx->BlockOff < 0xA000)
-		{
-			// System area as well as general area.
-			ctx->changed_system = true;
-		}
-		if (ctx->BlockOffLow < 0xA000)
-		{
-			// BlockOffLow shouldn't be less than 0xA000.
-			// Otherwise, we end up with double writing.
-			// (Not a problem; just wastes time.)
-			ctx->BlockOffLow = 0xA000;
-			ctx->changed_system = true;
-		}
-	}
+	// Mark the modified blocks for saving.
+	GCNCard_MarkDirty(ctx, ctx->BlockOff, length);
+	// The rest of an erased block has to read back as 0xFF.
+	GCNCard_FillErased(ctx, ctx->BlockOff, length);
 
 	// FIXME: Verify that this doesn't go out of bounds.
 	sync_before_read((void*)data, length);
@@ -448,9 +583,35 @@ void GCNCard_Read(int slot, void *data, u32 length)
 		return;
 	GCNCard_ctx *const ctx = &memCard[slot];
 
-	// FIXME: Verify that this doesn't go out of bounds.
-	sync_before_read(&ctx->base[ctx->BlockOff], length);
-	memcpy(data, &ctx->base[ctx->BlockOff], length);
+	if (ctx->erased_count == 0)
+	{
+		// FIXME: Verify that this doesn't go out of bounds.
+		sync_before_read(&ctx->base[ctx->BlockOff], length);
+		memcpy(data, &ctx->base[ctx->BlockOff], length);
+		sync_after_write(data, length);
+		return;
+	}
+
+	// Erased blocks read back as 0xFF.
+	u8 *ptr = (u8*)data;
+	u32 offset = ctx->BlockOff;
+	u32 left = length;
+	while (left > 0)
+	{
+		u32 size = CARD_BLOCK_SIZE - (offset & (CARD_BLOCK_SIZE - 1));
+		if (size > left)
+			size = left;
+		if (GCNCard_IsErased(ctx, offset >> CARD_BLOCK_SHIFT))
+			memset(ptr, 0xFF, size);
+		else
+		{
+			sync_before_read(&ctx->base[offset], size);
+			memcpy(ptr, &ctx->base[offset], size);
+		}
+		ptr += size;
+		offset += size;
+		left -= size;
+	}
 	sync_after_write(data, length);
 }
 
@@ -466,6 +627,31 @@ u32 GCNCard_GetCode(int slot)
 	return memCard[slot].code;
 }
 
+/**
+ * Erase the sector at the current block offset.
+ * The sector reads back as 0xFF from now on.
+ * @param slot Slot number.
+ */
+void GCNCard_Erase(int slot)
+{
+	if (!GCNCard_IsEnabled(slot))
+		return;
+	GCNCard_ctx *const ctx = &memCard[slot];
+
+	const u32 block = ctx->BlockOff >> CARD_BLOCK_SHIFT;
+	if (block >= (ctx->size >> CARD_BLOCK_SHIFT))
+		return;
+	ctx->changed = true;
+
+	if (!GCNCard_IsErased(ctx, block))
+	{
+		ctx->erased[block >> 5] |= 1U << (block & 31);
+		ctx->erased_count++;
+	}
+	// Saved along with the writes that usually follow.
+	GCNCard_MarkDirty(ctx, block << CARD_BLOCK_SHIFT, CARD_BLOCK_SIZE);
+}
+
 /**
  * Set the current block offset. (ERASE mode; uses sector values only.)
  * @param slot Slot number.
@@ -43,6 +43,15 @@ bool GCNCard_CheckChanges(void);
  */
 void GCNCard_Save(void);
 
+/**
+ * Write back part of the memory card changes.
+ * Call again while it returns true; the next call continues
+ * where this one stopped.
+ * @param budget Time budget, in HW_TIMER ticks. (0 == no limit)
+ * @return True if there are more changes to write; false if not.
+ */
+bool GCNCard_Flush(u32 budget);
+
 /** Functions used by EXIDeviceMemoryCard(). **/
 
 void GCNCard_ClearWriteCount(int slot);
@@ -77,6 +86,13 @@ void GCNCard_Read(int slot, void *data, u32 length);
  */
 u32 GCNCard_GetCode(int slot);
 
+/**
+ * Erase the sector at the current block offset.
+ * The sector reads back as 0xFF from now on.
+ * @param slot Slot number.
+ */
+void GCNCard_Erase(int slot);
+
 /**
  * Set the current block offset. (ERASE mode; uses sector values only.)
  * @param slot Slot number.
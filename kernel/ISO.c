@@ -24,10 +24,15 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "GCNCard.h"
 #include "debug.h"
 #include "wdvd.h"
+#include "inflate.h"
+#include "DITrace.h"
+#include "Stream.h"
 
 #include "ff_utf8.h"
+#include "diskio.h"
 
 extern u32 TRIGame;
+extern u32 FSTMode;
 extern u32 DiscRequested;
 extern bool wiiVCInternal;
 
@@ -36,26 +41,128 @@ u32 ISOFileOpen = 0;
 #define CACHE_MAX		0x400
 #define CACHE_START		(u8*)0x11000000
 #define CACHE_SIZE		0x1E80000
+#define CACHE_ALIGN		0x20
+#define DC_NONE			0xFFFF
 
 typedef struct
 {
 	u32 Offset;
-	u32 Size;
+	u32 Size;	// 0 if the slot is free
 	u8 *Data;
+	u16 Prev;	// neighbours in cache memory order
+	u16 Next;	// (next free slot if unused)
+	u32 Referenced;	// hit since the clock hand last passed
 } DataCache;
 
+typedef struct
+{
+	u32 Lookups;
+	u32 Hits;
+	u32 Misses;
+	u32 Evictions;
+	u32 Prefetches;
+	u32 Preloads;
+	u32 Seeks;
+	u32 Probes;	// binary search steps over all lookups
+	u32 Direct;	// game reads that bypassed the cache
+} DataCacheStats;
+
+// Read-ahead: recent game read streams.
+#define PREFETCH_STREAMS	4
+#define PREFETCH_MIN		0x8000
+#define PREFETCH_MAX		0x40000
+#define PREFETCH_STRIDE_MAX	0x400000
+
+// Large game reads go straight to their destination, unless
+// they are read again. Then they are worth caching.
+#define DIRECT_MIN		0x40000
+#define DIRECT_SEEN_MAX		16
+
+typedef struct
+{
+	u32 Offset;	// last read of this stream
+	u32 Length;
+	u32 Stride;	// 0 if unknown
+	u32 Matches;	// reads that followed the pattern
+	u32 Used;	// LRU stamp, 0 if unused
+} PrefetchStream;
+
 static u32 CacheInited = 0;
-static u32 TempCacheCount = 0;
+// Clock hand: cache memory is handed out as a ring,
+// DCHand is the first used slot at or after DataCacheOffset.
 static u32 DataCacheOffset = 0;
+static u16 DCHand = DC_NONE;
+static u16 DCHead = DC_NONE;
+static u16 DCTail = DC_NONE;
+static u16 DCFreeSlot = DC_NONE;
 static u8 *DCCache = CACHE_START;
 static u32 DCacheLimit = CACHE_SIZE;
 static DataCache DC[CACHE_MAX];
 
-extern u32 USBReadTimer;
+// DC slots sorted by disc offset.
+// No indexed entry contains another one, so the end offsets
+// are sorted as well and a binary search finds any hit.
+static u16 DCIndex[CACHE_MAX];
+static u32 DCIndexCount = 0;
+static DataCacheStats DCStats;
+
+static PrefetchStream PFStream[PREFETCH_STREAMS];
+static u32 PFStamp = 0;
+static u32 PFOffset = 0;
+static vu32 PFLength = 0;	// polled by the main thread
+
+// Preload of the previous session's hottest reads.
+static u32 PLIndex = 0;		// next preload list entry
+static u32 PLDone = 0;		// bytes of that entry already loaded
+static vu32 PLBudget = 0;	// bytes left to preload
+
+// Offsets of recent direct reads, plus one. 0 if unused.
+static u32 DirectSeen[DIRECT_SEEN_MAX];
+static u32 DirectSeenPos = 0;
+
 static FIL GameFile;
-static u64 LastOffset64 = ~0ULL;
+static u64 LastOffset64 = ~0ULL;	// ISO offset after the last read
+static u64 FilePos64 = ~0ULL;		// physical file position
 bool Datel = false;
 
+// Raw sector reads: the image file as a list of device sector
+// extents, converted in place from the fast-seek link map.
+typedef struct
+{
+	u32 LBA;	// first device sector
+	u32 End;	// file sector after this extent
+} ISOExtent;
+
+static ISOExtent *ISOExtents = NULL;
+static u32 ISOExtentCount = 0;	// 0 if reads go through FatFS
+static u32 ISOSectorShift;
+static BYTE ISODrive;
+static u8 ISOSectorBuf[_MAX_SS] ALIGNED(32);
+
+// Two-disc games: the other disc is opened in the background, and its
+// header and FST are read into the standby area right below the DI
+// trace area. A disc change then takes over the open file, and the
+// data cache is seeded from the standby area.
+#define STANDBY_AREA_SIZE	0x40000
+#define STANDBY_AREA		(DITRACE_AREA - STANDBY_AREA_SIZE)
+#define STANDBY_HEADER_SIZE	0x2440
+
+enum
+{
+	STANDBY_NONE = 0,	// single disc, or nothing left to do
+	STANDBY_OPEN,		// StandbyPath has to be opened
+	STANDBY_HEADER,		// open, header not read yet
+	STANDBY_READY,		// open, standby area filled
+};
+
+static u32 StandbyState = STANDBY_NONE;
+static char StandbyPath[256];
+static FIL StandbyFile;
+static bool StandbyHeader = false;	// standby area holds the header
+static u32 StandbyFSTOffset;
+static u32 StandbyFSTSize;		// 0 if the FST didn't fit
+static bool StandbySeed = false;	// seed the cache on the next setup
+
 // CISO: On-disc structure.
 // Temporarily loaded into cache memory.
 #define CISO_MAGIC	0x4349534F /* "CISO" */
@@ -74,186 +181,792 @@ typedef struct _CISO_t {
 static uint16_t ciso_block_map[CISO_MAP_SIZE];
 static bool ISO_IsCISO = false;	// Set to 1 for CISO mode.
 
+// GCZ: Dolphin compressed image.
+// Header and block pointers are little-endian.
+#define GCZ_MAGIC		0xB10BC001
+#define GCZ_HEADER_SIZE		0x20
+#define GCZ_BLOCK_SIZE_MAX	0x40000
+#define GCZ_BLOCK_CACHE_SIZE	0x100000
+#define GCZ_BLOCK_CACHE_MAX	32
+#define GCZ_STORED		0x80000000	// block is not compressed
+// Block index and decompressed blocks sit right below the standby area.
+#define GCZ_AREA_END		STANDBY_AREA
+typedef struct _GCZ_t {
+	u32 magic;			// 0xB10BC001
+	u32 sub_type;
+	u64 compressed_data_size;
+	u64 data_size;
+	u32 block_size;
+	u32 num_blocks;
+} GCZ_t;
+
+static bool ISO_IsGCZ = false;	// Set to 1 for GCZ mode.
+static u32 GCZBlockSize;
+static u32 GCZBlockShift;
+static u32 GCZNumBlocks;
+static u64 GCZDataStart;	// file offset of block 0
+static u8 *GCZArea = GCZ_AREA_END;
+// Block file offsets relative to GCZDataStart, with one extra
+// entry marking the end of the last block.
+static u32 *GCZIndex;
+static u8 *GCZInBuf;
+// Decompressed blocks for reads that only need part of one.
+static u8 *GCZBlockData;
+static u32 GCZBlockCount;
+static u32 GCZBlockIdx[GCZ_BLOCK_CACHE_MAX];
+static u32 GCZBlockUsed[GCZ_BLOCK_CACHE_MAX];	// LRU stamp, 0 if unused
+static u32 GCZStamp;
+
 /**
- * Read directly from the ISO file.
- * CISO mapping is done here.
+ * Find the first index position whose entry starts at or after Offset.
+ * @param Offset Disc offset.
+ * @return Index position.
+ */
+static u32 DCIndexLowerBound(u32 Offset)
+{
+	u32 lo = 0, hi = DCIndexCount;
+	while (lo < hi)
+	{
+		u32 mid = (lo + hi) >> 1;
+		DCStats.Probes++;
+		if (DC[DCIndex[mid]].Offset < Offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * Remove a DC slot from the index.
+ * @param pos DC slot.
+ */
+static void DCIndexRemove(u32 pos)
+{
+	u32 i = DCIndexLowerBound(DC[pos].Offset);
+	if (i < DCIndexCount && DCIndex[i] == pos)
+	{
+		memmove(&DCIndex[i], &DCIndex[i+1], (DCIndexCount - i - 1) * sizeof(u16));
+		DCIndexCount--;
+	}
+}
+
+/**
+ * Give a DC slot and its cache memory back.
+ * The slot must not be in the index anymore.
+ * @param pos DC slot.
+ */
+static void DCRelease(u32 pos)
+{
+	if (DC[pos].Prev != DC_NONE)
+		DC[DC[pos].Prev].Next = DC[pos].Next;
+	else
+		DCHead = DC[pos].Next;
+	if (DC[pos].Next != DC_NONE)
+		DC[DC[pos].Next].Prev = DC[pos].Prev;
+	else
+		DCTail = DC[pos].Prev;
+	if (DCHand == pos)
+		DCHand = DC[pos].Next;
+
+	DC[pos].Size = 0;
+	DC[pos].Next = DCFreeSlot;
+	DCFreeSlot = pos;
+}
+
+/**
+ * Add a DC slot to the index.
+ * Entries fully covered by the new one are dropped.
+ * @param pos DC slot.
+ */
+static void DCIndexInsert(u32 pos)
+{
+	const u32 End = DC[pos].Offset + DC[pos].Size;
+	u32 i = DCIndexLowerBound(DC[pos].Offset);
+	u32 j = i;
+	while (j < DCIndexCount && DC[DCIndex[j]].Offset + DC[DCIndex[j]].Size <= End)
+		DCRelease(DCIndex[j++]);
+	if (j != i + 1)
+	{
+		memmove(&DCIndex[i+1], &DCIndex[j], (DCIndexCount - j) * sizeof(u16));
+		DCIndexCount = DCIndexCount + 1 - (j - i);
+	}
+	DCIndex[i] = pos;
+}
+
+/**
+ * Find a cached disc range.
+ * @param Offset Disc offset.
+ * @param Length Data length.
+ * @return DC slot containing the range, or -1 if not cached.
+ */
+static s32 DCIndexFind(u32 Offset, u32 Length)
+{
+	u32 i = DCIndexLowerBound(Offset + 1);
+
+	// Last entry starting at or before Offset has the highest end.
+	if (i == 0 || Offset + Length > DC[DCIndex[i-1]].Offset + DC[DCIndex[i-1]].Size)
+		return -1;
+
+	return DCIndex[i-1];
+}
+
+/**
+ * Look up a cached disc range for a game read.
+ * @param Offset Disc offset.
+ * @param Length Data length.
+ * @return DC slot containing the range, or -1 if not cached.
+ */
+static s32 DCIndexLookup(u32 Offset, u32 Length)
+{
+	DCStats.Lookups++;
+	s32 pos = DCIndexFind(Offset, Length);
+	if (pos < 0)
+	{
+		DCStats.Misses++;
+		return -1;
+	}
+
+	DCStats.Hits++;
+	DC[pos].Referenced = 1;
+	return pos;
+}
+
+/**
+ * Allocate cache memory for a new DC slot.
+ * The clock hand sweeps the ring and evicts whatever is in the way,
+ * entries that were hit since the last pass get skipped once.
+ * @param Length Data length.
+ * @return DC slot, not yet in the index.
+ */
+static u32 DCAlloc(u32 Length)
+{
+	const u32 Need = ALIGN_FORWARD(Length, CACHE_ALIGN);
+	u32 Skipped = 0;
+	while (1)
+	{
+		if (DataCacheOffset + Need > DCacheLimit)
+		{	// wrap around
+			DataCacheOffset = 0;
+			DCHand = DCHead;
+		}
+		const u32 pos = DCHand;
+		if (pos == DC_NONE)
+		{
+			if (DCFreeSlot != DC_NONE)
+				break;
+			// Out of slots, keep sweeping from the start.
+			DataCacheOffset = 0;
+			DCHand = DCHead;
+		}
+		else if ((u32)(DC[pos].Data - DCCache) >= DataCacheOffset + Need && DCFreeSlot != DC_NONE)
+			break;
+		else if (DC[pos].Referenced && Skipped < DCacheLimit)
+		{	// second chance
+			const u32 Alloc = ALIGN_FORWARD(DC[pos].Size, CACHE_ALIGN);
+			DC[pos].Referenced = 0;
+			DataCacheOffset = (u32)(DC[pos].Data - DCCache) + Alloc;
+			Skipped += Alloc;
+			DCHand = DC[pos].Next;
+		}
+		else
+		{
+			DCIndexRemove(pos);
+			DCRelease(pos);
+			DCStats.Evictions++;
+		}
+	}
+
+	// Take a free slot and link it in front of the hand.
+	const u32 pos = DCFreeSlot;
+	DCFreeSlot = DC[pos].Next;
+	DC[pos].Data = DCCache + DataCacheOffset;
+	DC[pos].Size = Length;
+	DC[pos].Referenced = 0;
+	DC[pos].Next = DCHand;
+	DC[pos].Prev = (DCHand != DC_NONE) ? DC[DCHand].Prev : DCTail;
+	if (DC[pos].Prev != DC_NONE)
+		DC[DC[pos].Prev].Next = pos;
+	else
+		DCHead = pos;
+	if (DCHand != DC_NONE)
+		DC[DCHand].Prev = pos;
+	else
+		DCTail = pos;
+
+	DataCacheOffset += Need;
+	return pos;
+}
+
+/**
+ * Read from the image file with raw device sector reads.
+ * Whole sectors go straight to the buffer in one transfer per
+ * extent, partial ones through the sector buffer.
  * @param Buffer Output buffer.
  * @param Length Data length.
- * @param Offset ISO file offset. (Must have ISOShift64 added!)
+ * @param FileOffset64 Physical file offset.
+ * @return Bytes read.
  */
-static inline void ISOReadDirect(void *Buffer, u32 Length, u64 Offset64)
+static u32 ISOReadExtents(u8 *Buffer, u32 Length, u64 FileOffset64)
 {
-	if(ISOFileOpen == 0)
-		return;
+	const u32 SectorSize = 1U << ISOSectorShift;
+	const u64 FileSize64 = f_size(&GameFile);
+	if(FileOffset64 >= FileSize64)
+		return 0;
+	if(Length > FileSize64 - FileOffset64)
+		Length = FileSize64 - FileOffset64;
 
-	UINT read;
-	if (!ISO_IsCISO)
+	u32 Sector = (u32)(FileOffset64 >> ISOSectorShift);
+	u32 Skip = (u32)FileOffset64 & (SectorSize - 1);
+	u32 Left = Length;
+
+	// First extent ending after Sector.
+	u32 lo = 0, hi = ISOExtentCount;
+	while (lo < hi)
 	{
-		// Standard ISO/GCM file.
-		if(LastOffset64 != Offset64)
+		u32 mid = (lo + hi) >> 1;
+		if (ISOExtents[mid].End <= Sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	u32 e = lo;
+	while (Left > 0 && e < ISOExtentCount)
+	{
+		const u32 Start = e ? ISOExtents[e-1].End : 0;
+		const u32 LBA = ISOExtents[e].LBA + (Sector - Start);
+		if (Skip != 0 || Left < SectorSize)
 		{
-			if(wiiVCInternal)
-				WDVD_FST_LSeek( Offset64 );
-			else
-				f_lseek( &GameFile, Offset64 );
+			u32 Part = SectorSize - Skip;
+			if (Part > Left)
+				Part = Left;
+			if (disk_read(ISODrive, ISOSectorBuf, LBA, 1) != RES_OK)
+				break;
+			memcpy(Buffer, ISOSectorBuf + Skip, Part);
+			Buffer += Part;
+			Left -= Part;
+			Skip = 0;
+			Sector++;
 		}
-		if(wiiVCInternal)
+		else
 		{
-			sync_before_read( Buffer, Length );
-			read = WDVD_FST_Read( Buffer, Length );
+			u32 Count = ISOExtents[e].End - Sector;
+			if (Count > (Left >> ISOSectorShift))
+				Count = Left >> ISOSectorShift;
+			if (disk_read(ISODrive, Buffer, LBA, Count) != RES_OK)
+				break;
+			Buffer += Count << ISOSectorShift;
+			Left -= Count << ISOSectorShift;
+			Sector += Count;
 		}
+		if (Sector >= ISOExtents[e].End)
+			e++;
+	}
+	return Length - Left;
+}
+
+/**
+ * Turn the fast-seek link map into device sector extents.
+ * The link map is overwritten, so FatFS must not read
+ * the file anymore once this succeeds.
+ * @return True if the extents cover the file; false if not.
+ */
+static bool ISOExtentInit(void)
+{
+	const FATFS *fs = GameFile.obj.fs;
+#if _MAX_SS != _MIN_SS
+	const u32 SectorSize = fs->ssize;
+#else
+	const u32 SectorSize = _MAX_SS;
+#endif
+	DWORD *tbl = GameFile.cltbl + 1;
+	u64 Sectors = 0;
+	u32 i, n;
+
+	ISOExtentCount = 0;
+	for (ISOSectorShift = 0; (1U << ISOSectorShift) < SectorSize; ISOSectorShift++) ;
+
+	// Check the whole file is mapped before touching the map.
+	for (i = 0; tbl[i] != 0; i += 2)
+	{
+		if (tbl[i+1] < 2)
+			return false;
+		Sectors += (u64)tbl[i] * fs->csize;
+	}
+	if (Sectors > 0xFFFFFFFF || (Sectors << ISOSectorShift) < f_size(&GameFile))
+		return false;
+
+	// Each (clusters, start cluster) pair becomes an extent.
+	ISOExtents = (ISOExtent*)tbl;
+	for (i = 0, n = 0, Sectors = 0; tbl[i] != 0; i += 2, n++)
+	{
+		const u32 Count = tbl[i] * fs->csize;
+		const u32 LBA = fs->database + (tbl[i+1] - 2) * fs->csize;
+		Sectors += Count;
+		ISOExtents[n].LBA = LBA;
+		ISOExtents[n].End = (u32)Sectors;
+	}
+	ISODrive = fs->drv;
+	ISOExtentCount = n;
+	return n != 0;
+}
+
+/**
+ * Read from the image file at a physical file offset.
+ * The seek is skipped if the file is already there.
+ * @param Buffer Output buffer.
+ * @param Length Data length.
+ * @param FileOffset64 Physical file offset.
+ * @return Bytes read.
+ */
+static u32 ISOReadFile(void *Buffer, u32 Length, u64 FileOffset64)
+{
+	UINT read;
+	if(FilePos64 != FileOffset64)
+	{
+		if(ISOExtentCount != 0)
+			;	// raw reads have no file position
+		else if(wiiVCInternal)
+			WDVD_FST_LSeek( FileOffset64 );
 		else
-			f_read( &GameFile, Buffer, Length, &read );
+			f_lseek( &GameFile, FileOffset64 );
+		DCStats.Seeks++;
+	}
+	if(ISOExtentCount != 0)
+		read = ISOReadExtents(Buffer, Length, FileOffset64);
+	else if(wiiVCInternal)
+	{
+		sync_before_read( Buffer, Length );
+		read = WDVD_FST_Read( Buffer, Length );
+	}
+	else
+		f_read( &GameFile, Buffer, Length, &read );
+
+	FilePos64 = (read == Length) ? FileOffset64 + Length : ~0ULL;
+	return read;
+}
+
+/**
+ * Zero-fill an empty CISO range.
+ * memset() works bytewise, so do the aligned part in words.
+ * @param ptr8 Output buffer.
+ * @param Length Data length.
+ */
+static void ISOZeroFill(u8 *ptr8, u32 Length)
+{
+	u32 head = (u32)(ALIGN_FORWARD(ptr8, 4) - ptr8);
+	if (head > Length)
+		head = Length;
+	memset(ptr8, 0, head);
+	ptr8 += head;
+	Length -= head;
+
+	memset32(ptr8, 0, Length & ~3);
+	memset(ptr8 + (Length & ~3), 0, Length & 3);
+}
+
+/**
+ * Read a value from an image header.
+ * Done bytewise so it works on either host byte order.
+ * @param ptr Value.
+ * @return Value in host byte order.
+ */
+static inline u32 ISOReadLE32(const void *ptr)
+{
+	const u8 *p = (const u8*)ptr;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static inline u32 ISOReadBE32(const void *ptr)
+{
+	const u8 *p = (const u8*)ptr;
+	return ((u32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline u64 ISOReadLE64(const void *ptr)
+{
+	return ISOReadLE32(ptr) | ((u64)ISOReadLE32((const u8*)ptr + 4) << 32);
+}
+
+/**
+ * Decompress a GCZ block.
+ * @param Buffer Output buffer. (GCZBlockSize bytes)
+ * @param Block Block number.
+ * @return True on success; false on error.
+ */
+static bool GCZReadBlock(u8 *Buffer, u32 Block)
+{
+	const u32 Start = GCZIndex[Block] & ~GCZ_STORED;
+	const u32 End = GCZIndex[Block+1] & ~GCZ_STORED;
+	if (End < Start || End - Start > GCZBlockSize)
+		return false;
+
+	const u32 Size = End - Start;
+	s32 Out = Size;
+	if (GCZIndex[Block] & GCZ_STORED)
+	{
+		if (ISOReadFile(Buffer, Size, GCZDataStart + Start) != Size)
+			return false;
 	}
 	else
 	{
-		// CISO. Handle individual blocks.
-		// TODO: LastOffset64 optimization?
-		u8 *ptr8 = (u8*)Buffer;
+		if (ISOReadFile(GCZInBuf, Size, GCZDataStart + Start) != Size)
+			return false;
+		Out = inflate_zlib(Buffer, GCZBlockSize, GCZInBuf, Size);
+		if (Out < 0)
+		{
+			dbgprintf("ISO:GCZ block %u is corrupt\r\n", Block);
+			return false;
+		}
+	}
+
+	// The last block may be short.
+	if ((u32)Out < GCZBlockSize)
+		ISOZeroFill(Buffer + Out, GCZBlockSize - Out);
+	return true;
+}
+
+/**
+ * Get a decompressed GCZ block from the block cache.
+ * @param Block Block number.
+ * @return Block data, or NULL on error.
+ */
+static const u8 *GCZGetBlock(u32 Block)
+{
+	u32 i, lru = 0;
+	GCZStamp++;
+	for (i = 0; i < GCZBlockCount; ++i)
+	{
+		if (GCZBlockUsed[i] && GCZBlockIdx[i] == Block)
+		{
+			GCZBlockUsed[i] = GCZStamp;
+			return GCZBlockData + (i << GCZBlockShift);
+		}
+		if (GCZBlockUsed[i] < GCZBlockUsed[lru])
+			lru = i;
+	}
+
+	u8 *Data = GCZBlockData + (lru << GCZBlockShift);
+	if (!GCZReadBlock(Data, Block))
+	{
+		GCZBlockUsed[lru] = 0;
+		return NULL;
+	}
+	GCZBlockIdx[lru] = Block;
+	GCZBlockUsed[lru] = GCZStamp;
+	return Data;
+}
+
+/**
+ * Set up GCZ mode: load the block pointers into MEM2.
+ * @param hdr GCZ header, as read from the file.
+ * @return True if the image can be used; false if not.
+ */
+static bool GCZInit(const GCZ_t *hdr)
+{
+	const u32 BlockSize = ISOReadLE32(&hdr->block_size);
+	const u32 NumBlocks = ISOReadLE32(&hdr->num_blocks);
+	const u64 CompSize = ISOReadLE64(&hdr->compressed_data_size);
+	u32 i;
+
+	// Only power of two block sizes, and block offsets
+	// have to fit in 31 bits.
+	if (BlockSize < 0x800 || BlockSize > GCZ_BLOCK_SIZE_MAX ||
+	    (BlockSize & (BlockSize - 1)) || NumBlocks == 0 || CompSize >= GCZ_STORED)
+	{
+		dbgprintf("ISO:Unsupported GCZ, block size %08X\r\n", BlockSize);
+		return false;
+	}
+
+	u32 BlockCount = GCZ_BLOCK_CACHE_SIZE / BlockSize;
+	if (BlockCount > GCZ_BLOCK_CACHE_MAX)
+		BlockCount = GCZ_BLOCK_CACHE_MAX;
+	const u32 IndexSize = ALIGN_FORWARD((NumBlocks + 1) * sizeof(u32), CACHE_ALIGN);
+	const u32 AreaSize = BlockCount * BlockSize + BlockSize + IndexSize;
+	if (AreaSize > CACHE_SIZE / 4)
+		return false;
+	GCZArea = GCZ_AREA_END - AreaSize;
+	GCZBlockData = GCZArea;
+	GCZInBuf = GCZBlockData + BlockCount * BlockSize;
+	GCZIndex = (u32*)(GCZInBuf + BlockSize);
 
-		// Check if we're not starting on a block boundary.
-		const u32 blockStartOffset = (u32)(Offset64 % CISO_BLOCK_SIZE);
-		if (blockStartOffset != 0)
+	// The pointer table follows the header,
+	// convert it in DI_READ_BUFFER sized chunks.
+	u64 *ptrs = (u64*)DI_READ_BUFFER;
+	const u32 PerChunk = DI_READ_BUFFER_LENGTH / sizeof(u64);
+	for (i = 0; i < NumBlocks; )
+	{
+		u32 n = NumBlocks - i, j;
+		if (n > PerChunk)
+			n = PerChunk;
+		if (ISOReadFile(ptrs, n * sizeof(u64), GCZ_HEADER_SIZE + (u64)i * sizeof(u64)) != n * sizeof(u64))
+			return false;
+		for (j = 0; j < n; ++j, ++i)
 		{
-			// Not a block boundary.
-			// Read the end of the block.
-			u32 read_sz = CISO_BLOCK_SIZE - blockStartOffset;
-			if (Length < read_sz)
-				read_sz = Length;
-
-			// Get the physical block number first.
-			const u32 blockStart = Offset64 / CISO_BLOCK_SIZE;
-			if (blockStart >= CISO_MAP_SIZE)
+			const u64 ptr = ISOReadLE64(&ptrs[j]);
+			const u64 Start = ptr & ~(1ULL << 63);
+			if (Start > CompSize)
+				return false;
+			GCZIndex[i] = (u32)Start | ((ptr >> 63) ? GCZ_STORED : 0);
+		}
+	}
+	GCZIndex[NumBlocks] = (u32)CompSize;
+
+	GCZBlockSize = BlockSize;
+	for (GCZBlockShift = 0; (1U << GCZBlockShift) < BlockSize; GCZBlockShift++) ;
+	GCZNumBlocks = NumBlocks;
+	// Block data comes after the pointers and the block hashes.
+	GCZDataStart = GCZ_HEADER_SIZE + (u64)NumBlocks * (sizeof(u64) + sizeof(u32));
+	GCZBlockCount = BlockCount;
+	memset32(GCZBlockUsed, 0, sizeof(GCZBlockUsed));
+	GCZStamp = 0;
+
+	dbgprintf("ISO:GCZ image, %u blocks of %08X bytes\r\n", NumBlocks, BlockSize);
+	return true;
+}
+
+/**
+ * Read directly from the ISO file.
+ * CISO mapping and GCZ decompression are done here.
+ * @param Buffer Output buffer.
+ * @param Length Data length.
+ * @param Offset ISO file offset. (Must have ISOShift64 added!)
+ */
+static inline void ISOReadDirect(void *Buffer, u32 Length, u64 Offset64)
+{
+	if(ISOFileOpen == 0 && FSTMode == 0)
+		return;
+
+	if (FSTMode)
+	{
+		// Extracted game, the files are looked up by disc offset.
+		FSTReadDirect(Buffer, Length, (u32)Offset64);
+	}
+	else if (ISO_IsGCZ)
+	{
+		// GCZ. Whole blocks are decompressed straight into
+		// the output buffer, partial ones go through the block cache.
+		u8 *ptr8 = (u8*)Buffer;
+		u32 Left = Length;
+		u64 Pos64 = Offset64;
+		while (Left > 0)
+		{
+			const u32 Block = (u32)(Pos64 >> GCZBlockShift);
+			if (Block >= GCZNumBlocks)
 			{
 				// Out of range.
 				return;
 			}
 
-			const u16 physBlockStartIdx = ciso_block_map[blockStart];
-			if (physBlockStartIdx == 0xFFFF)
+			const u32 blockOffset = (u32)Pos64 & (GCZBlockSize - 1);
+			u32 read_sz = GCZBlockSize - blockOffset;
+			if (read_sz > Left)
+				read_sz = Left;
+
+			if (read_sz == GCZBlockSize)
 			{
-				// Empty block.
-				memset(ptr8, 0, read_sz);
+				if (!GCZReadBlock(ptr8, Block))
+					return;
 			}
 			else
 			{
-				// Seek to the physical block address.
-				const u32 physBlockStartAddr = CISO_HEADER_SIZE + ((u32)physBlockStartIdx * CISO_BLOCK_SIZE);
-				if(wiiVCInternal)
-				{
-					WDVD_FST_LSeek( physBlockStartAddr + blockStartOffset );
-					sync_before_read( ptr8, read_sz );
-					read = WDVD_FST_Read( ptr8, read_sz );
-				}
-				else
-				{
-					f_lseek(&GameFile, physBlockStartAddr + blockStartOffset);
-					// Read read_sz bytes.
-					f_read(&GameFile, ptr8, read_sz, &read);
-				}
-				if (read != read_sz)
-				{
-					// Error reading the data.
+				const u8 *Data = GCZGetBlock(Block);
+				if (Data == NULL)
 					return;
-				}
+				memcpy(ptr8, Data + blockOffset, read_sz);
 			}
 
-			// Starting block read.
-			Length -= read_sz;
+			Left -= read_sz;
 			ptr8 += read_sz;
-			Offset64 += read_sz;
+			Pos64 += read_sz;
 		}
-
-		// Read entire blocks.
-		for (; Length >= CISO_BLOCK_SIZE;
-		    Length -= CISO_BLOCK_SIZE, ptr8 += CISO_BLOCK_SIZE,
-		    Offset64 += CISO_BLOCK_SIZE)
+	}
+	else if (!ISO_IsCISO)
+	{
+		// Standard ISO/GCM file.
+		ISOReadFile(Buffer, Length, Offset64);
+	}
+	else
+	{
+		// CISO. Blocks that follow each other in the file
+		// are read in one go, empty blocks are zero-filled.
+		u8 *ptr8 = (u8*)Buffer;
+		u32 Left = Length;
+		u64 Pos64 = Offset64;
+		while (Left > 0)
 		{
-			const u32 blockIdx = (u32)(Offset64 / CISO_BLOCK_SIZE);
+			u32 blockIdx = (u32)(Pos64 / CISO_BLOCK_SIZE);
 			if (blockIdx >= CISO_MAP_SIZE)
 			{
 				// Out of range.
 				return;
 			}
 
+			const u32 blockOffset = (u32)(Pos64 % CISO_BLOCK_SIZE);
 			const u16 physBlockIdx = ciso_block_map[blockIdx];
-			if (physBlockIdx == 0xFFFF)
-			{
-				// Empty block.
-				memset(ptr8, 0, CISO_BLOCK_SIZE);
-			}
-			else
-			{
-				// Seek to the physical block address.
-				const u32 physBlockAddr = CISO_HEADER_SIZE + ((u32)physBlockIdx * CISO_BLOCK_SIZE);
-				if(wiiVCInternal)
-				{
-					WDVD_FST_LSeek( physBlockAddr );
-					sync_before_read( ptr8, CISO_BLOCK_SIZE );
-					read = WDVD_FST_Read( ptr8, CISO_BLOCK_SIZE );
-				}
-				else
-				{
-					f_lseek(&GameFile, physBlockAddr);
-					// Read one block worth of data.
-					f_read(&GameFile, ptr8, CISO_BLOCK_SIZE, &read);
-				}
-				if (read != CISO_BLOCK_SIZE)
-				{
-					// Error reading the data.
-					return;
-				}
-			}
-		}
-
-		// Check if we still have data left. (not a full block)
-		if (Length > 0) {
-			// Not a full block.
+			u32 read_sz = CISO_BLOCK_SIZE - blockOffset;
 
-			// Get the physical block number first.
-			const u32 blockEnd = (u32)(Offset64 / CISO_BLOCK_SIZE);
-			if (blockEnd >= CISO_MAP_SIZE)
+			// Extend the run over following blocks of the same kind.
+			u16 nextPhysIdx = physBlockIdx;
+			while (read_sz < Left && ++blockIdx < CISO_MAP_SIZE)
 			{
-				// Out of range.
-				return;
+				if (physBlockIdx != 0xFFFF)
+					nextPhysIdx++;
+				if (ciso_block_map[blockIdx] != nextPhysIdx)
+					break;
+				read_sz += CISO_BLOCK_SIZE;
 			}
+			if (read_sz > Left)
+				read_sz = Left;
 
-			const u16 physBlockEndIdx = ciso_block_map[blockEnd];
-			if (physBlockEndIdx == 0xFFFF)
+			if (physBlockIdx == 0xFFFF)
 			{
-				// Empty block.
-				memset(ptr8, 0, Length);
+				// Empty blocks.
+				ISOZeroFill(ptr8, read_sz);
 			}
 			else
 			{
-				// Seek to the physical block address.
-				const u32 physBlockEndAddr = CISO_HEADER_SIZE + ((u32)physBlockEndIdx * CISO_BLOCK_SIZE);
-				if(wiiVCInternal)
-				{
-					WDVD_FST_LSeek( physBlockEndAddr );
-					sync_before_read( ptr8, Length );
-					read = WDVD_FST_Read( ptr8, Length );
-				}
-				else
-				{
-					f_lseek(&GameFile, physBlockEndAddr);
-					// Read Length bytes.
-					f_read(&GameFile, ptr8, Length, &read);
-				}
-				if (read != Length)
+				const u64 physAddr = CISO_HEADER_SIZE + ((u64)physBlockIdx * CISO_BLOCK_SIZE) + blockOffset;
+				if (ISOReadFile(ptr8, read_sz, physAddr) != read_sz)
 				{
 					// Error reading the data.
 					return;
 				}
 			}
 
-			Offset64 += Length;
+			Left -= read_sz;
+			ptr8 += read_sz;
+			Pos64 += read_sz;
 		}
 	}
 
 	LastOffset64 = Offset64 + Length;
-	//refresh read timeout
-	USBReadTimer = read32(HW_TIMER);
+}
+
+#if _USE_FASTSEEK
+/**
+ * Set up the fast-seek link map of an image file.
+ * @param fp Open file.
+ * @return FR_OK if the map is complete.
+ */
+static FRESULT ISOCreateLinkMap(FIL *fp)
+{
+	u32 tblsize = 4; //minimum default size
+	fp->cltbl = malloc(tblsize * sizeof(DWORD));
+	fp->cltbl[0] = tblsize;
+	FRESULT ret = f_lseek(fp, CREATE_LINKMAP);
+	if( ret == FR_NOT_ENOUGH_CORE )
+	{	/* We need more table mem */
+		tblsize = fp->cltbl[0];
+		free(fp->cltbl);
+		dbgprintf("ISO:Fragmented, allocating %08x\r\n", tblsize);
+		fp->cltbl = malloc(tblsize * sizeof(DWORD));
+		fp->cltbl[0] = tblsize;
+		ret = f_lseek(fp, CREATE_LINKMAP);
+	}
+	return ret;
+}
+#endif /* _USE_FASTSEEK */
+
+/**
+ * Close the standby disc, if it is open.
+ */
+static void ISOCloseStandby(void)
+{
+	if(StandbyState == STANDBY_HEADER || StandbyState == STANDBY_READY)
+	{
+		f_close( &StandbyFile );
+#if _USE_FASTSEEK
+		free(StandbyFile.cltbl);
+		StandbyFile.cltbl = NULL;
+#endif /* _USE_FASTSEEK */
+	}
+	StandbyState = STANDBY_NONE;
+	StandbyHeader = false;
+}
+
+/**
+ * Set the disc to open in the background.
+ * @param Path Image path of the other disc; NULL for none.
+ */
+void ISOSetStandby(const char *Path)
+{
+	ISOCloseStandby();
+	if(Path == NULL || wiiVCInternal)
+		return;
+	_sprintf(StandbyPath, "%s", Path);
+	StandbyState = STANDBY_OPEN;
+}
+
+/**
+ * Do the next step of preparing the standby disc.
+ * Runs on the DI thread between game reads.
+ * @return True if there was something to do.
+ */
+static bool ISOStandbyStep(void)
+{
+	u8 *Area = (u8*)STANDBY_AREA;
+	u32 read;
+
+	if(StandbyState == STANDBY_OPEN)
+	{
+		if( f_open_char( &StandbyFile, StandbyPath, FA_READ|FA_OPEN_EXISTING ) != FR_OK )
+		{
+			StandbyState = STANDBY_NONE;
+			return true;
+		}
+#if _USE_FASTSEEK
+		if( ISOCreateLinkMap(&StandbyFile) != FR_OK )
+		{	/* the map is incomplete, don't use it */
+			free(StandbyFile.cltbl);
+			StandbyFile.cltbl = NULL;
+		}
+#endif /* _USE_FASTSEEK */
+		StandbyState = STANDBY_HEADER;
+		dbgprintf("ISO:Standby disc %s opened\r\n", StandbyPath);
+		return true;
+	}
+	if(StandbyState == STANDBY_HEADER)
+	{
+		StandbyState = STANDBY_READY;
+		StandbyFSTSize = 0;
+
+		// Only plain images hold disc offsets at file offsets.
+		f_lseek( &StandbyFile, 0 );
+		if( f_read( &StandbyFile, Area, STANDBY_HEADER_SIZE, &read ) != FR_OK ||
+			read != STANDBY_HEADER_SIZE || ISOReadBE32(Area + 0x1C) != 0xC2339F3D )
+			return true;
+		StandbyHeader = true;
+
+		u32 FSTOffset = ISOReadBE32(Area + 0x424);
+		u32 FSTSize = ISOReadBE32(Area + 0x428);
+		if( FSTSize == 0 || FSTSize > STANDBY_AREA_SIZE - STANDBY_HEADER_SIZE )
+			return true;
+		f_lseek( &StandbyFile, FSTOffset );
+		if( f_read( &StandbyFile, Area + STANDBY_HEADER_SIZE, FSTSize, &read ) == FR_OK && read == FSTSize )
+		{
+			StandbyFSTOffset = FSTOffset;
+			StandbyFSTSize = FSTSize;
+		}
+		dbgprintf("ISO:Standby header read, FST:%08X\r\n", StandbyFSTSize);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Add data to the cache.
+ * @param Offset Disc offset.
+ * @param Data Data.
+ * @param Length Data length.
+ */
+static void ISOCacheInsert(u32 Offset, const u8 *Data, u32 Length)
+{
+	u32 pos = DCAlloc(Length);
+	DC[pos].Offset = Offset;
+	DCIndexInsert(pos);
+	memcpy(DC[pos].Data, Data, Length);
 }
 
 // ISO shift offset.
@@ -269,43 +982,55 @@ bool ISOInit()
 	}
 	else
 	{
-		s32 ret = f_open_char( &GameFile, ConfigGetGamePath(), FA_READ|FA_OPEN_EXISTING );
-		if( ret != FR_OK )
-			return false;
-
+		ISOExtentCount = 0;
+		s32 ret;
+		if( (StandbyState == STANDBY_HEADER || StandbyState == STANDBY_READY) &&
+			strcmp( StandbyPath, ConfigGetGamePath() ) == 0 )
+		{	/* Disc change, take over the file opened in the background */
+			memcpy( &GameFile, &StandbyFile, sizeof(FIL) );
+			ret = FR_OK;
 #if _USE_FASTSEEK
-		/* Setup table */
-		u32 tblsize = 4; //minimum default size
-		GameFile.cltbl = malloc(tblsize * sizeof(DWORD));
-		GameFile.cltbl[0] = tblsize;
-		ret = f_lseek(&GameFile, CREATE_LINKMAP);
-		if( ret == FR_NOT_ENOUGH_CORE )
-		{	/* We need more table mem */
-			tblsize = GameFile.cltbl[0];
-			free(GameFile.cltbl);
-			dbgprintf("ISO:Fragmented, allocating %08x\r\n", tblsize);
-			GameFile.cltbl = malloc(tblsize * sizeof(DWORD));
-			GameFile.cltbl[0] = tblsize;
-			f_lseek(&GameFile, CREATE_LINKMAP);
+			if( GameFile.cltbl == NULL )
+				ret = FR_NOT_ENOUGH_CORE;
+#endif /* _USE_FASTSEEK */
+			StandbySeed = StandbyHeader;
+			StandbyState = STANDBY_NONE;
+			dbgprintf("ISO:Using standby disc\r\n");
 		}
+		else
+		{
+			ret = f_open_char( &GameFile, ConfigGetGamePath(), FA_READ|FA_OPEN_EXISTING );
+			if( ret != FR_OK )
+				return false;
+#if _USE_FASTSEEK
+			/* Setup table */
+			ret = ISOCreateLinkMap(&GameFile);
+#endif /* _USE_FASTSEEK */
+		}
+#if _USE_FASTSEEK
+		/* Bypass FatFS for reads if the map is complete */
+		if( ret == FR_OK && ISOExtentInit() )
+			dbgprintf("ISO:Raw sector reads, %u extents\r\n", ISOExtentCount);
 #endif /* _USE_FASTSEEK */
 	}
 
 	/* Setup direct reader */
 	ISOFileOpen = 1;
 	LastOffset64 = ~0ULL;
+	FilePos64 = ~0ULL;
 	ISO_IsCISO = false;
+	ISO_IsGCZ = false;
+	memset32(PFStream, 0, sizeof(PFStream));
+	PFLength = 0;
+	memset32(DirectSeen, 0, sizeof(DirectSeen));
 
 	/* Check for CISO format. */
 	CISO_t *tmp_ciso = (CISO_t*)malloca(0x8000, 0x20);
 	ISOReadDirect(tmp_ciso, 0x8000, 0);
-	if (tmp_ciso->magic == CISO_MAGIC)
+	if (ISOReadBE32(&tmp_ciso->magic) == CISO_MAGIC)
 	{
 		// Only CISOs with 2 MB block sizes are supported.
-		u32 block_size = ((tmp_ciso->block_size >> 24) & 0x000000FF) |
-				 ((tmp_ciso->block_size >>  8) & 0x0000FF00) |
-				 ((tmp_ciso->block_size <<  8) & 0x00FF0000) |
-				 ((tmp_ciso->block_size << 24) & 0xFF000000);
+		u32 block_size = ISOReadLE32(&tmp_ciso->block_size);
 		if (block_size == CISO_BLOCK_SIZE)
 		{
 			// CISO has 2 MB blocks.
@@ -341,6 +1066,11 @@ bool ISOInit()
 			ISO_IsCISO = true;
 		}
 	}
+	else if (ISOReadLE32(&tmp_ciso->magic) == GCZ_MAGIC)
+	{
+		// Enable GCZ mode if the block layout is usable.
+		ISO_IsGCZ = GCZInit((const GCZ_t*)tmp_ciso);
+	}
 	free(tmp_ciso);
 
 	/* Set Low Mem */
@@ -381,11 +1111,19 @@ void ISOClose()
 	}
 	ISOFileOpen = 0;
 	ISO_IsCISO = false;
+	ISO_IsGCZ = false;
+	CacheInited = 0;
+
+	dbgprintf("ISO:Cache lookups:%u hits:%u misses:%u evictions:%u prefetches:%u preloads:%u direct:%u seeks:%u probes:%u extents:%u\r\n",
+		DCStats.Lookups, DCStats.Hits, DCStats.Misses, DCStats.Evictions,
+		DCStats.Prefetches, DCStats.Preloads, DCStats.Direct, DCStats.Seeks, DCStats.Probes, ISOExtentCount);
+	ISOExtentCount = 0;
+	ISOExtents = NULL;
 }
 
 void ISOSetupCache()
 {
-	if(ISOFileOpen == 0 || CacheInited)
+	if((ISOFileOpen == 0 && FSTMode == 0) || CacheInited)
 		return;
 
 	DCCache = CACHE_START;
@@ -410,12 +1148,61 @@ void ISOSetupCache()
 		DCCache += MemCardSize; //memcard is before cache
 		DCacheLimit -= MemCardSize;
 	}
+	if (!TRIGame && ConfigGetConfig(NIN_CFG_DTK_CACHE))
+	{
+		// decoded DTK loops are after memcard
+		StreamSetCache(DCCache, STREAM_CACHE_SIZE);
+		DCCache += STREAM_CACHE_SIZE;
+		DCacheLimit -= STREAM_CACHE_SIZE;
+	}
+	else
+		StreamSetCache(NULL, 0);
+	if (DITrace_Active() && DCCache + DCacheLimit > DITRACE_AREA)
+	{
+		// trace ring and preload list are after cache
+		DCacheLimit = DITRACE_AREA - DCCache;
+	}
+	if ((StandbyState != STANDBY_NONE || StandbySeed) && DCCache + DCacheLimit > STANDBY_AREA)
+	{
+		// standby disc header and FST are after cache
+		DCacheLimit = STANDBY_AREA - DCCache;
+	}
+	if (ISO_IsGCZ && DCCache + DCacheLimit > GCZArea)
+	{
+		// GCZ block index and buffers are after cache
+		DCacheLimit = GCZArea - DCCache;
+	}
+	if (FSTMode && DCCache + DCacheLimit > FSTGetIndexArea())
+	{
+		// FST file index is after cache
+		DCacheLimit = FSTGetIndexArea() - DCCache;
+	}
 	memset32(DC, 0, sizeof(DataCache)* CACHE_MAX);
+	u32 i;
+	for( i = 0; i < CACHE_MAX; ++i )
+		DC[i].Next = (i + 1 < CACHE_MAX) ? i + 1 : DC_NONE;
+	DCFreeSlot = 0;
+	DCHead = DCTail = DCHand = DC_NONE;
+	DCIndexCount = 0;
+	memset32(&DCStats, 0, sizeof(DataCacheStats));
 
 	DataCacheOffset = 0;
-	TempCacheCount = 0;
+
+	// Leave room for what the game actually reads.
+	PLIndex = 0;
+	PLDone = 0;
+	PLBudget = DCacheLimit / 2;
 
 	CacheInited = 1;
+
+	if (StandbySeed && !ISO_IsCISO && !ISO_IsGCZ && ISOShift64 == 0)
+	{
+		// Changed disc, its header and FST were read ahead
+		ISOCacheInsert(0, (u8*)STANDBY_AREA, STANDBY_HEADER_SIZE);
+		if (StandbyFSTSize != 0)
+			ISOCacheInsert(StandbyFSTOffset, (u8*)STANDBY_AREA + STANDBY_HEADER_SIZE, StandbyFSTSize);
+	}
+	StandbySeed = false;
 }
 
 void ISOSeek(u32 Offset)
@@ -423,9 +1210,14 @@ void ISOSeek(u32 Offset)
 	if(ISOFileOpen == 0)
 		return;
 
+	// GCZ file offsets are only known per block.
+	if(ISO_IsGCZ)
+		return;
+
 	const u64 Offset64 = (u64)Offset + ISOShift64;
 	if(LastOffset64 != Offset64)
 	{
+		u64 FileOffset64 = Offset64;
 		if (ISO_IsCISO)
 		{
 			const u32 blockIdx = (u32)(Offset64 / CISO_BLOCK_SIZE);
@@ -437,18 +1229,16 @@ void ISOSeek(u32 Offset)
 				return;
 
 			const u32 blockOffset = (u32)(Offset64 % CISO_BLOCK_SIZE);
-			const u32 physAddr = CISO_HEADER_SIZE + ((u32)physBlockIdx * CISO_BLOCK_SIZE) + blockOffset;
-			if(wiiVCInternal)
-				WDVD_FST_LSeek( physAddr );
-			else
-				f_lseek( &GameFile, physAddr );
+			FileOffset64 = CISO_HEADER_SIZE + ((u64)physBlockIdx * CISO_BLOCK_SIZE) + blockOffset;
 		}
-		else
+		if(FilePos64 != FileOffset64 && ISOExtentCount == 0)
 		{
 			if(wiiVCInternal)
-				WDVD_FST_LSeek( Offset64 );
+				WDVD_FST_LSeek( FileOffset64 );
 			else
-				f_lseek( &GameFile, Offset64 );
+				f_lseek( &GameFile, FileOffset64 );
+			FilePos64 = FileOffset64;
+			DCStats.Seeks++;
 		}
 		LastOffset64 = Offset64;
 	}
@@ -463,17 +1253,23 @@ const u8 *ISORead(u32* Length, u32 Offset)
 		ISOReadDirect(DI_READ_BUFFER, *Length, Offset);
 		return DI_READ_BUFFER;
 	}
-	u32 i;
-
-	for( i = 0; i < CACHE_MAX; ++i )
+	s32 hit = DCIndexLookup(Offset, *Length);
+	if( hit < 0 && *Length >= DIRECT_MIN )
 	{
-		if(DC[i].Size == 0) continue;
-		if( Offset >= DC[i].Offset && Offset + *Length <= DC[i].Offset + DC[i].Size )
+		// Large reads take a cached head, the rest
+		// is picked up by the next call.
+		hit = DCIndexFind(Offset, 1);
+		if( hit >= 0 )
 		{
-			//dbgprintf("DI: Cached Read Offset:%08X Size:%08X Buffer:%p\r\n", DC[i].Offset, DC[i].Size, DC[i].Data );
-			return DC[i].Data + (Offset - DC[i].Offset);
+			DC[hit].Referenced = 1;
+			*Length = DC[hit].Offset + DC[hit].Size - Offset;
 		}
 	}
+	if( hit >= 0 )
+	{
+		//dbgprintf("DI: Cached Read Offset:%08X Size:%08X Buffer:%p\r\n", DC[hit].Offset, DC[hit].Size, DC[hit].Data );
+		return DC[hit].Data + (Offset - DC[hit].Offset);
+	}
 
 	u64 Offset64 = Offset + ISOShift64;
 	if( (Offset64 == LastOffset64) && (*Length < 0x8000) )
@@ -482,28 +1278,220 @@ const u8 *ISORead(u32* Length, u32 Offset)
 		while((*Length += OriLength) < 0x10000) ;
 	}
 
-	// case we ran out of positions
-	if( TempCacheCount >= CACHE_MAX )
-		TempCacheCount = 0;
+	// dont let a single read flush the whole cache,
+	// the rest is picked up by the next call
+	if( *Length > DCacheLimit / 4 )
+		*Length = DCacheLimit / 4;
+
+	u32 pos = DCAlloc(*Length);
+	DC[pos].Offset = Offset;
+	DCIndexInsert(pos);
+
+	ISOReadDirect(DC[pos].Data, *Length, Offset64);
+	return DC[pos].Data;
+}
+
+/**
+ * Read a large game read straight into its destination.
+ * Saves copying it through the cache. Reads with a cached head
+ * or ones that were read before go through ISORead() instead.
+ * @param Buffer Destination.
+ * @param Length [in/out] Data length; bytes read on return.
+ * @param Offset Disc offset.
+ * @return True if the data was read; false to use ISORead().
+ */
+bool ISOReadTo(u8 *Buffer, u32 *Length, u32 Offset)
+{
+	if((ISOFileOpen == 0 && FSTMode == 0) || *Length < DIRECT_MIN)
+		return false;
 
-	// case we filled up the cache
-	if( (DataCacheOffset + *Length) >= DCacheLimit )
+	if(CacheInited)
 	{
-		for( i = 0; i < CACHE_MAX; ++i )
-			DC[i].Size = 0; //quickly delete old cache content
-		DataCacheOffset = 0;
-		TempCacheCount = 0;
+		if( DCIndexFind(Offset, 1) >= 0 )
+			return false;
+
+		// Stop at the next cached range.
+		u32 i = DCIndexLowerBound(Offset);
+		if( i < DCIndexCount && DC[DCIndex[i]].Offset - Offset < *Length )
+			*Length = DC[DCIndex[i]].Offset - Offset;
+		if( *Length < DIRECT_MIN )
+			return false;
+
+		for( i = 0; i < DIRECT_SEEN_MAX; ++i )
+		{
+			if( DirectSeen[i] == Offset + 1 )
+			{	// read again, keep it this time
+				DirectSeen[i] = 0;
+				return false;
+			}
+		}
+		DirectSeen[DirectSeenPos] = Offset + 1;
+		DirectSeenPos = (DirectSeenPos + 1) % DIRECT_SEEN_MAX;
+		DCStats.Direct++;
 	}
 
-	u32 pos = TempCacheCount;
-	TempCacheCount++;
+	ISOReadDirect(Buffer, *Length, Offset + ISOShift64);
+	return true;
+}
 
-	DC[pos].Data = DCCache + DataCacheOffset;
-	DC[pos].Offset = Offset;
-	DC[pos].Size = *Length;
+/**
+ * Track a finished game read for read-ahead.
+ * Sequential and constant stride streams predict their next read.
+ * @param Offset Disc offset.
+ * @param Length Data length.
+ */
+void ISOPrefetchNote(u32 Offset, u32 Length)
+{
+	if(CacheInited == 0 || Length == 0)
+		return;
 
-	ISOReadDirect(DC[pos].Data, *Length, Offset64);
+	u32 i, Next = 0;
+	PrefetchStream *s = NULL;
+	PFStamp++;
 
-	DataCacheOffset += *Length;
-	return DC[pos].Data;
+	for( i = 0; i < PREFETCH_STREAMS; ++i )
+	{
+		PrefetchStream *cur = &PFStream[i];
+		if( cur->Used == 0 )
+			continue;
+		if( Offset == cur->Offset + cur->Length )
+			Next = Offset + Length;
+		else if( cur->Stride && Offset == cur->Offset + cur->Stride )
+			Next = Offset + cur->Stride;
+		else
+			continue;
+		s = cur;
+		s->Matches++;
+		break;
+	}
+
+	if( s == NULL )
+	{
+		// Either the second read of a strided stream or a new stream.
+		for( i = 0; i < PREFETCH_STREAMS; ++i )
+		{
+			PrefetchStream *cur = &PFStream[i];
+			if( cur->Used && cur->Matches == 0 && cur->Stride == 0 &&
+				Offset > cur->Offset && Offset - cur->Offset <= PREFETCH_STRIDE_MAX )
+			{
+				s = cur;
+				s->Stride = Offset - cur->Offset;
+				break;
+			}
+		}
+		if( s == NULL )
+		{
+			s = &PFStream[0];
+			for( i = 1; i < PREFETCH_STREAMS; ++i )
+			{
+				if( PFStream[i].Used < s->Used )
+					s = &PFStream[i];
+			}
+			s->Stride = 0;
+			s->Matches = 0;
+		}
+	}
+
+	s->Offset = Offset;
+	s->Length = Length;
+	s->Used = PFStamp;
+
+	if( Next == 0 )
+		return;
+
+	if( Length < PREFETCH_MIN )
+		Length = PREFETCH_MIN;
+	else if( Length > PREFETCH_MAX )
+		Length = PREFETCH_MAX;
+	PFOffset = Next;
+	PFLength = Length;
+}
+
+bool ISOPrefetchPending(void)
+{
+	return PFLength != 0 || (CacheInited && PLBudget != 0) ||
+		StandbyState == STANDBY_OPEN || StandbyState == STANDBY_HEADER;
+}
+
+/**
+ * Read the next hot range of the previous session into the cache.
+ * Ranges that are still cached are skipped.
+ * @param Offset [out] Disc offset.
+ * @return Data length, or 0 if there is nothing left to preload.
+ */
+static u32 ISOPreloadNext(u32 *Offset)
+{
+	u32 Count;
+	const DITracePreload *List = DITrace_GetPreload(&Count);
+	if(List == NULL)
+		Count = 0;
+
+	while( PLIndex < Count && PLBudget != 0 )
+	{
+		const DITracePreload *e = &List[PLIndex];
+		u32 Length = e->Length - PLDone;
+		if( Length > PREFETCH_MAX )
+			Length = PREFETCH_MAX;
+		if( Length > PLBudget )
+			Length = PLBudget;
+		*Offset = e->Offset + PLDone;
+
+		PLDone += Length;
+		if( PLDone >= e->Length )
+		{
+			PLIndex++;
+			PLDone = 0;
+		}
+		if( DCIndexFind(*Offset, Length) >= 0 )
+			continue;
+
+		PLBudget -= Length;
+		return Length;
+	}
+
+	PLBudget = 0;
+	return 0;
+}
+
+/**
+ * Read the predicted range into the cache.
+ * With no stream to follow, the previous session's hot reads are preloaded.
+ * Runs on the DI thread between game reads.
+ */
+void ISOPrefetch(void)
+{
+	u32 Offset = PFOffset;
+	u32 Length = PFLength;
+	PFLength = 0;
+
+	if(ISOFileOpen == 0)
+		return;
+	if(CacheInited == 0)
+	{
+		ISOStandbyStep();
+		return;
+	}
+	if(Length != 0)
+	{
+		if(DCIndexFind(Offset, Length) >= 0)
+			return;
+		DCStats.Prefetches++;
+	}
+	else
+	{
+		Length = ISOPreloadNext(&Offset);
+		if(Length == 0)
+		{
+			// Nothing to read ahead for this disc
+			ISOStandbyStep();
+			return;
+		}
+		DCStats.Preloads++;
+	}
+
+	u32 pos = DCAlloc(Length);
+	DC[pos].Offset = Offset;
+	DCIndexInsert(pos);
+
+	ISOReadDirect(DC[pos].Data, Length, Offset + ISOShift64);
 }
@@ -24,7 +24,13 @@ extern bool Datel;
 bool ISOInit();
 void ISOClose();
 void ISOSetupCache();
+void ISOSetStandby(const char *Path);
 const u8 *ISORead(u32* Length, u32 Offset);
+bool ISOReadTo(u8 *Buffer, u32 *Length, u32 Offset);
 void ISOSeek(u32 Offset);
 
+void ISOPrefetchNote(u32 Offset, u32 Length);
+bool ISOPrefetchPending(void);
+void ISOPrefetch(void);
+
 #endif
@@ -0,0 +1,136 @@
+// Nintendont (kernel): idle-time work.
+// One job runs per main loop pass, in the order of the job table.
+// Each job gets a time budget it should try to stay within.
+
+#include "Idle.h"
+#include "DI.h"
+#include "GCNCard.h"
+#include "vsprintf.h"
+#include "debug.h"
+
+extern u32 USBReadTimer;
+
+// HW_TIMER ticks.
+#define IDLE_SECOND		1898437
+#define IDLE_MSEC		1898
+
+// Memcard writeback delay after the last change.
+#define CARD_DELAY_SECS		2
+// USB drives spin down after a few minutes without I/O.
+#define KEEPALIVE_SECS		149
+
+typedef struct _IdleJob
+{
+	bool (*Run)(u32 Budget);	// true if it kept the main thread busy
+	u32 Interval;	// ticks between runs, 0 for every pass
+	u32 Budget;	// ticks a run should take at most
+	u32 Last;	// HW_TIMER of the last run
+} IdleJob;
+
+static bool KeepAliveWanted = false;
+static bool CardDirty = false;
+static u32 CardTimer = 0;
+
+static inline bool CardFlushDue(void)
+{
+	/* Wait for the game to be done writing */
+	return CardDirty && TimerDiffSeconds(CardTimer) > CARD_DELAY_SECS;
+}
+
+static bool IdleCardFlush(u32 Budget)
+{
+	if(!CardFlushDue())
+		return false;
+	/* The DI thread may be using the device */
+	if(!DIIsIdle())
+		return false;
+	/* A chunk at a time, it continues on the next pass */
+	CardDirty = GCNCard_Flush(Budget);
+	return true;
+}
+
+static bool IdleKeepAlive(u32 Budget)
+{
+	/* Any real I/O refreshes the timer, so this only reads when needed */
+	if(!KeepAliveWanted || TimerDiffSeconds(USBReadTimer) <= KEEPALIVE_SECS)
+		return false;
+	if(DIStartKeepAlive())
+		USBReadTimer = read32(HW_TIMER);
+	return false; //done by the DI thread
+}
+
+static bool IdleLogFlush(u32 Budget)
+{
+	/* The DI thread may be using the device */
+	if(!DIIsIdle())
+		return false;
+	return LogFlush();
+}
+
+static bool IdlePrefetch(u32 Budget)
+{
+	/* Let a started memcard flush get the device first */
+	if(CardFlushDue())
+		return false;
+	DIStartPrefetch();
+	return false; //done by the DI thread
+}
+
+static IdleJob IdleJobs[] =
+{
+	{ IdleCardFlush,	0,		5 * IDLE_MSEC,	0 },
+	{ IdleKeepAlive,	IDLE_SECOND,	0,		0 },
+	{ IdleLogFlush,		IDLE_SECOND,	5 * IDLE_MSEC,	0 },
+	{ IdlePrefetch,		0,		0,		0 },
+};
+#define IDLE_JOBS	(sizeof(IdleJobs) / sizeof(IdleJobs[0]))
+
+void IdleInit(bool KeepAlive)
+{
+	u32 i;
+	u32 Now = read32(HW_TIMER);
+	for(i = 0; i < IDLE_JOBS; ++i)
+		IdleJobs[i].Last = Now;
+	KeepAliveWanted = KeepAlive;
+	CardDirty = false;
+}
+
+bool IdleRun(void)
+{
+	u32 i;
+	for(i = 0; i < IDLE_JOBS; ++i)
+	{
+		IdleJob *Job = &IdleJobs[i];
+		if(Job->Interval != 0 && TimerDiffTicks(Job->Last) < Job->Interval)
+			continue;
+		Job->Last = read32(HW_TIMER);
+		if(Job->Run(Job->Budget))
+		{
+#ifdef DEBUG_IDLE
+			u32 Took = TimerDiffTicks(Job->Last);
+			if(Job->Budget != 0 && Took > Job->Budget)
+				dbgprintf("Idle:Job %u took %u ticks\r\n", i, Took);
+#endif
+			return true;
+		}
+	}
+	return false;
+}
+
+void IdleCardChanged(void)
+{
+	CardTimer = read32(HW_TIMER);
+	CardDirty = true;
+}
+
+void IdleCardSync(void)
+{
+	if(!CardDirty)
+		return;
+	/* Wait for the DI thread to be done with the device */
+	DIFinishAsync();
+	DIFinishPrefetch();
+	DIFinishStreamRead();
+	GCNCard_Save();
+	CardDirty = false;
+}
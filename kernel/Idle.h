@@ -0,0 +1,33 @@
+// Nintendont (kernel): idle-time work.
+// Low-priority jobs run from the main loop while no DI command is pending:
+// memcard flush, USB keep-alive, log flush and cache prefetch.
+
+#ifndef __IDLE_H__
+#define __IDLE_H__
+
+#include "global.h"
+
+/**
+ * Set up the idle jobs.
+ * @param KeepAlive Keep a USB drive from spinning down.
+ */
+void IdleInit(bool KeepAlive);
+
+/**
+ * Run the next due idle job.
+ * Only call this while no DI command is pending.
+ * @return True if a job kept the main thread busy; false if not.
+ */
+bool IdleRun(void);
+
+/**
+ * The emulated memcard changed and has to be written back.
+ */
+void IdleCardChanged(void);
+
+/**
+ * Write back all memcard changes now, for a reset.
+ */
+void IdleCardSync(void);
+
+#endif /* __IDLE_H__ */
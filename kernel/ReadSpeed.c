@@ -23,21 +23,118 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 // This file exists to emulate the disc read speed
 // The data used comes from my D2C wii disc drive
 
-static u32 SEEK_TICKS = 94922; // 50 ms
-static float READ_TICKS = 1.657f; // 3 MB/s
 static const u32 READ_BLOCK = 65536; // 64 KB
 static const float CACHE_TICKS = 8.627f; // 15.6 MB/s
 static const u32 CACHE_SIZE = 1048576; // 1 MB
 #define MIN(a, b)		(((a)>(b))?(b):(a))
 
+// The drive spins at a constant angular velocity, so the transfer
+// rate grows with the radius. The disc is split into zones of equal
+// size, each read at the rate of its middle.
+#define DISC_SIZE		0x57058000 // 1.4 GB
+#define ZONE_COUNT		16
+#define ZONE_SIZE		(DISC_SIZE / ZONE_COUNT)
+
+// Timing models.
+enum
+{
+	MODEL_CAV = 0,	// seeks, zones and the drive cache like real hardware
+	MODEL_FIXED,	// same time for the same read, for speedrun practice
+};
+
+typedef struct _ReadSpeedProfile
+{
+	u32 TitleID;	// 0 for the default
+	u32 Model;
+	u32 SeekMin;	// ticks; per read for MODEL_FIXED
+	u32 SeekMax;	// ticks for a full stroke seek
+	u32 Motor;	// ticks for a motor command
+	float ReadInner;	// bytes per tick at the start of the disc
+	float ReadOuter;	// bytes per tick at the end of the disc
+} ReadSpeedProfile;
+
+// Per-title overrides, the default comes last.
+static const ReadSpeedProfile Profiles[] =
+{
+	// King Kong: 150 ms, 2 MB/s
+	{ 0x47574B, MODEL_CAV, 284765, 284765, 284765, 1.1f, 1.1f },
+	// Default: 20-75 ms (50 ms on average), 50 ms motor, 2.3-3.8 MB/s (3 MB/s on average)
+	{ 0, MODEL_CAV, 37969, 142383, 94922, 1.2f, 2.0f },
+};
+// Deterministic mode: 2 ms, 50 ms motor, 6 MB/s
+static const ReadSpeedProfile FixedProfile = { 0, MODEL_FIXED, 3797, 3797, 94922, 3.314f, 3.314f };
+
+static const ReadSpeedProfile *Profile = NULL;
+static float ZoneTicks[ZONE_COUNT]; // bytes per tick
+static u32 SeekScale = 1; // square root of DISC_SIZE in sectors
+
 static u32 CMDStartTime = 0;
 static u32 CMDLastFinish = 0;
 static u32 CMDTicks = UINT_MAX;
 static u32 CMDBaseBlock = UINT_MAX;
 static u32 CMDLastBlock = UINT_MAX;
+static u32 CMDHeadPos = 0;
 
 extern u32 TITLE_ID;
 
+static u32 isqrt(u32 x)
+{
+	u32 res = 0;
+	u32 bit = 1u << 30;
+	while(bit > x)
+		bit >>= 2;
+	while(bit != 0)
+	{
+		if(x >= res + bit)
+		{
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else
+			res >>= 1;
+		bit >>= 2;
+	}
+	return res;
+}
+
+static inline float ZoneRate(u32 Offset)
+{
+	return ZoneTicks[MIN(Offset / ZONE_SIZE, ZONE_COUNT - 1)];
+}
+
+/**
+ * Time for moving the head, growing with the square root of the distance.
+ * @param From Disc offset after the last read.
+ * @param To Disc offset of the next read.
+ * @return Ticks.
+ */
+static u32 SeekTicks(u32 From, u32 To)
+{
+	u32 Distance = (From > To ? From - To : To - From) >> 11;
+	u32 Range = Profile->SeekMax - Profile->SeekMin;
+	return Profile->SeekMin + Range * isqrt(Distance) / SeekScale;
+}
+
+/**
+ * Time for reading from the disc surface.
+ * @param Offset Disc offset.
+ * @param Length Length.
+ * @return Ticks.
+ */
+static u32 TransferTicks(u32 Offset, u32 Length)
+{
+	u32 Ticks = 0;
+	while(Length > 0)
+	{
+		u32 ZoneEnd = (Offset / ZONE_SIZE + 1) * ZONE_SIZE;
+		u32 Part = (Offset >= DISC_SIZE - ZONE_SIZE) ? Length : MIN(Length, ZoneEnd - Offset);
+		Ticks += Part / ZoneRate(Offset);
+		Offset += Part;
+		Length -= Part;
+	}
+	return Ticks;
+}
+
 void ReadSpeed_Init()
 {
 	if(ConfigGetConfig(NIN_CFG_REMLIMIT))
@@ -47,13 +144,37 @@ void ReadSpeed_Init()
 	CMDTicks = UINT_MAX;
 	CMDBaseBlock = UINT_MAX;
 	CMDLastBlock = UINT_MAX;
+	CMDHeadPos = 0;
+
+	if(ConfigGetConfig(NIN_CFG_FAST_READ))
+	{
+		dbgprintf("ReadSpeed:Using Fixed Settings\r\n");
+		Profile = &FixedProfile;
+	}
+	else
+	{
+		for(Profile = Profiles; Profile->TitleID != 0; ++Profile)
+		{
+			if(Profile->TitleID == TITLE_ID)
+			{
+				dbgprintf("ReadSpeed:Using Settings for %06X\r\n", TITLE_ID);
+				break;
+			}
+		}
+	}
 
-	if(TITLE_ID == 0x47574B) //King Kong
+	// Rate at radius r is Inner * r / r0, and with the data spread
+	// evenly over the surface, r^2 grows linearly with the offset.
+	float Ratio = Profile->ReadOuter / Profile->ReadInner;
+	float Growth = Ratio * Ratio - 1.0f;
+	u32 i;
+	for(i = 0; i < ZONE_COUNT; ++i)
 	{
-		dbgprintf("ReadSpeed:Using Slow Settings\r\n");
-		SEEK_TICKS = 284765; // 150 ms
-		READ_TICKS = 1.1f; // 2 MB/s
+		float Pos = (i * 2 + 1) / (float)(ZONE_COUNT * 2);
+		u32 RadiusSq = (u32)((1.0f + Pos * Growth) * (1 << 20));
+		ZoneTicks[i] = Profile->ReadInner * isqrt(RadiusSq) / (float)(1 << 10);
 	}
+	SeekScale = isqrt(DISC_SIZE >> 11);
 }
 
 u32 UseReadLimit = 1;
@@ -73,7 +194,7 @@ void ReadSpeed_Motor()
 		return;
 
 	CMDStartTime = read32(HW_TIMER);
-	CMDTicks = SEEK_TICKS;
+	CMDTicks = Profile->Motor;
 }
 
 void ReadSpeed_Setup(u32 Offset, int Length)
@@ -81,18 +202,25 @@ void ReadSpeed_Setup(u32 Offset, int Length)
 	if(UseReadLimit == 0)
 		return;
 
+	if(Profile->Model == MODEL_FIXED)
+	{	//no history, no cache
+		CMDTicks = Profile->SeekMin + TransferTicks(Offset, Length);
+		return;
+	}
+
 	u32 CurrentBlock = ALIGN_BACKWARD(Offset, READ_BLOCK);
 	if(CurrentBlock < CMDBaseBlock || //always seek and read
 		((Offset+Length) - CMDBaseBlock) > CACHE_SIZE)
 	{
-		CMDTicks = (Length / READ_TICKS) + SEEK_TICKS;
+		CMDTicks = TransferTicks(Offset, Length) + SeekTicks(CMDHeadPos, Offset);
 		//dbgprintf("Reading uncached, %u ticks\r\n", CMDTicks);
 		CMDBaseBlock = ALIGN_BACKWARD(Offset+Length, READ_BLOCK);
+		CMDHeadPos = Offset + Length;
 		return;
 	}
 	CMDTicks = 0; //start from fresh
 
-	u32 lenCached = MIN(TimerDiffTicks(CMDLastFinish) * READ_TICKS, CACHE_SIZE);
+	u32 lenCached = MIN(TimerDiffTicks(CMDLastFinish) * ZoneRate(CMDBaseBlock), CACHE_SIZE);
 	u32 CachedUpToOffset = CMDBaseBlock + READ_BLOCK + lenCached;
 
 	if(CachedUpToOffset > CurrentBlock)
@@ -107,7 +235,8 @@ void ReadSpeed_Setup(u32 Offset, int Length)
 		//dbgprintf("%i %i %u\r\n", CacheUsableLen, Length, CMDTicks);
 	}
 	if(Length > 0)
-		CMDTicks += Length / READ_TICKS;
+		CMDTicks += Length / ZoneRate(Offset);
+	CMDHeadPos = Offset + Length;
 
 	//dbgprintf("Reading possibly cached, %u ticks\r\n", CMDTicks);
 	if((CurrentBlock - CMDBaseBlock) > READ_BLOCK)
@@ -34,10 +34,19 @@ static s32 di_fd = -1;
 u32 RealDiscCMD = 0, RealDiscError = 0;
 
 //No ISO Cache so lets take alot of memory
-static u8 *const DISC_FRONT_CACHE = (u8*)0x12000000;
-static u8 *const DISC_DRIVE_BUFFER = (u8*)0x12000800;
-static const u32 DISC_DRIVE_BUFFER_LENGTH = 0x7FF000;
-static u8 *const DISC_TMP_CACHE = (u8*)0x127FF800;
+static u8 *const DISC_DRIVE_BUFFER = (u8*)0x12000000;
+static const u32 DISC_DRIVE_BUFFER_LENGTH = 0x800000;
+
+// The drive buffer is a read-ahead window: it holds the disc data from
+// DiscWinOffset on, and grows in the background while the game is busy,
+// so sequential reads don't have to wait for the drive.
+#define DISC_SECTOR		0x800		// full ISO-9660 sectors for DVD-R media
+#define READAHEAD_CHUNK		0x10000		// per background read
+#define READAHEAD_MAX		0x400000	// window size past the last game read
+static u64 DiscWinOffset = ~0;
+static u32 DiscWinLength = 0;	// valid bytes, a multiple of DISC_SECTOR
+static u32 DiscWinUsed = 0;	// end of the last game read in the window
+static bool DiscWinAhead = false;	// read-ahead not done yet
 
 static s32 realdiqueue = -1;
 static vu32 realdi_msgrecv = 0;
@@ -166,44 +175,32 @@ bool RealDI_NewDisc()
 	return false;
 }
 
-static u64 DVD_OFFSET64 = ~0;
 void ClearRealDiscBuffer(void)
 {
-	DVD_OFFSET64 = ~0;
+	DiscWinOffset = ~0;
+	DiscWinLength = 0;
+	DiscWinUsed = 0;
+	DiscWinAhead = false;
 	memset32(DISC_DRIVE_BUFFER, 0, DISC_DRIVE_BUFFER_LENGTH);
 	sync_after_write(DISC_DRIVE_BUFFER, DISC_DRIVE_BUFFER_LENGTH);
 }
 
 extern bool access_led;
 extern u64 ISOShift64;
-const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync)
-{
-	//dbgprintf("ReadRealDisc(%08x %08x)\r\n", *Length, Offset);
 
-	u32 CachedBlockStart = 0;
-	u32 ReadDiff = 0;
-
-	u32 TmpLen = *Length;
-	u64 TmpOffset = (u64)Offset + ISOShift64;
+/**
+ * Read sectors from the drive into the window.
+ * @param Pos Window position, a multiple of DISC_SECTOR.
+ * @param Length Length, a multiple of DISC_SECTOR.
+ * @param NeedSync Let the main thread wait for the drive.
+ * @return True on success.
+ */
+static bool RealDI_DriveRead(u32 Pos, u32 Length, bool NeedSync)
+{
+	u64 TmpOffset = DiscWinOffset + Pos;
+	bool ret = true;
 
-	if(RealDiscCMD == DIP_CMD_DVDR)
-	{
-		// Wii's disc drive can only read full ISO-9660
-		// sectors when using standard DVD media. (2048 bytes)
-		u64 AlignedOffset = ALIGN_BACKWARD(TmpOffset, 0x800);
-		ReadDiff = (u32)(TmpOffset - AlignedOffset);
-		if(AlignedOffset == DVD_OFFSET64)
-		{
-			sync_before_read(DISC_TMP_CACHE, 0x800);
-			//dbgprintf("Using cached offset %08llx\r\n", DVD_OFFSET64>>11);
-			memcpy(DISC_FRONT_CACHE, DISC_TMP_CACHE, 0x800);
-			CachedBlockStart = 0x800;
-			u32 AlignedLength = ALIGN_FORWARD(TmpLen + ReadDiff, 0x800);
-			if( AlignedLength > 0 && AlignedLength == CachedBlockStart )
-				return (DISC_FRONT_CACHE + ReadDiff);
-		}
-		//dbgprintf("ReadDiff: %08x\r\n", ReadDiff);
-	}
+	//dbgprintf("RealDI_DriveRead(%08llx %08x)\r\n", TmpOffset, Length);
 	if(NeedSync)
 	{
 		WaitForWrite = 1;
@@ -214,37 +211,26 @@ const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync)
 	//turn on drive led
 	if (access_led) set32(HW_GPIO_OUT, GPIO_SLOT_LED);
 
-	if (TmpLen > DISC_DRIVE_BUFFER_LENGTH - ReadDiff)
-	{
-		TmpLen = DISC_DRIVE_BUFFER_LENGTH - ReadDiff;
-		*Length = TmpLen;
-		//dbgprintf("New Length: %08x\r\n", TmpLen);
-	}
-
 	write32(DIP_STATUS, 0x54); //mask and clear interrupts
 
 	//Actually read
 	if (RealDiscCMD == DIP_CMD_DVDR)
 	{
-		// Adjust length and offset for DVD-R mode.
-		TmpLen = ALIGN_FORWARD(TmpLen + ReadDiff, 0x800) - CachedBlockStart;
-		TmpOffset = ALIGN_BACKWARD(TmpOffset, 0x800) + CachedBlockStart;
-
 		write32(DIP_CMD_0, DIP_CMD_DVDR << 24);
 		write32(DIP_CMD_1, (u32)(TmpOffset >> 11));
-		write32(DIP_CMD_2, TmpLen >> 11);
+		write32(DIP_CMD_2, Length >> 11);
 	}
 	else
 	{
 		write32(DIP_CMD_0, DIP_CMD_NORMAL << 24);
 		write32(DIP_CMD_1, (u32)(TmpOffset >> 2));
-		write32(DIP_CMD_2, TmpLen);
+		write32(DIP_CMD_2, Length);
 	}
 
 	//dbgprintf("Read %08x %08x\r\n", read32(DIP_CMD_1), read32(DIP_CMD_2));
-	sync_before_read(DISC_DRIVE_BUFFER, TmpLen);
-	write32(DIP_DMA_ADR, (u32)DISC_DRIVE_BUFFER);
-	write32(DIP_DMA_LEN, TmpLen);
+	sync_before_read(DISC_DRIVE_BUFFER + Pos, Length);
+	write32(DIP_DMA_ADR, (u32)DISC_DRIVE_BUFFER + Pos);
+	write32(DIP_DMA_LEN, Length);
 
 	write32( DIP_CONTROL, 3 );
 	udelay(70);
@@ -254,11 +240,14 @@ const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync)
 		WaitForRead = 1;
 		while(WaitForRead == 1)
 			udelay(200);
+		ret = (RealDiscError == 0);
 	}
 	else
 	{
 		while(read32(DIP_CONTROL) & 1)
 			udelay(200);
+		if(read32(DIP_STATUS) & 4)
+			ret = false;
 		write32(DIP_STATUS, 0x54); //mask and clear interrupts
 		udelay(70);
 	}
@@ -266,15 +255,88 @@ const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync)
 	//turn off drive led
 	if (access_led) clear32(HW_GPIO_OUT, GPIO_SLOT_LED);
 
-	if(RealDiscCMD == DIP_CMD_DVDR)
+	return ret;
+}
+
+const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync)
+{
+	//dbgprintf("ReadRealDisc(%08x %08x)\r\n", *Length, Offset);
+
+	u32 TmpLen = *Length;
+	u64 TmpOffset = (u64)Offset + ISOShift64;
+	u32 Pos, End;
+
+	// Wii's disc drive can only read full ISO-9660
+	// sectors when using standard DVD media. (2048 bytes)
+	// Normal reads use the same alignment to keep the window simple.
+	if(DiscWinOffset != ~0ULL && TmpOffset >= DiscWinOffset &&
+		TmpOffset - DiscWinOffset <= DiscWinLength)
+	{
+		Pos = (u32)(TmpOffset - DiscWinOffset);
+		End = ALIGN_FORWARD(Pos + TmpLen, DISC_SECTOR);
+		if(End <= DiscWinLength)
+			goto found; //read ahead already
+		if(End <= DISC_DRIVE_BUFFER_LENGTH)
+		{	//continue the window
+			if(!RealDI_DriveRead(DiscWinLength, End - DiscWinLength, NeedSync))
+				goto error;
+			DiscWinLength = End;
+			goto found;
+		}
+	}
+
+	//start a new window
+	DiscWinOffset = ALIGN_BACKWARD(TmpOffset, DISC_SECTOR);
+	DiscWinLength = 0;
+	Pos = (u32)(TmpOffset - DiscWinOffset);
+	if (TmpLen > DISC_DRIVE_BUFFER_LENGTH - Pos)
+	{
+		TmpLen = DISC_DRIVE_BUFFER_LENGTH - Pos;
+		*Length = TmpLen;
+		//dbgprintf("New Length: %08x\r\n", TmpLen);
+	}
+	End = ALIGN_FORWARD(Pos + TmpLen, DISC_SECTOR);
+	if(!RealDI_DriveRead(0, End, NeedSync))
+		goto error;
+	DiscWinLength = End;
+
+found:
+	DiscWinUsed = Pos + TmpLen;
+	DiscWinAhead = true;
+	return DISC_DRIVE_BUFFER + Pos;
+
+error:
+	//don't keep anything from a failed read
+	DiscWinOffset = ~0;
+	DiscWinLength = 0;
+	DiscWinAhead = false;
+	return DISC_DRIVE_BUFFER + Pos;
+}
+
+bool RealDI_PrefetchPending(void)
+{
+	return DiscWinAhead;
+}
+
+void RealDI_Prefetch(void)
+{
+	if(!DiscWinAhead)
+		return;
+
+	u32 Limit = ALIGN_FORWARD(DiscWinUsed + READAHEAD_MAX, DISC_SECTOR);
+	if(Limit > DISC_DRIVE_BUFFER_LENGTH)
+		Limit = DISC_DRIVE_BUFFER_LENGTH;
+	if(DiscWinLength >= Limit)
 	{
-		u64 LastBlockStart = ((u64)(read32(DIP_CMD_2)) - 1) << 11;
-		DVD_OFFSET64 = ((u64)(read32(DIP_CMD_1)) << 11) + LastBlockStart;
-		memcpy(DISC_TMP_CACHE, DISC_DRIVE_BUFFER + LastBlockStart, 0x800);
-		sync_after_write(DISC_TMP_CACHE, 0x800);
-		if(CachedBlockStart)
-			return (DISC_FRONT_CACHE + ReadDiff);
+		DiscWinAhead = false;
+		return;
 	}
 
-	return DISC_DRIVE_BUFFER + ReadDiff;
+	u32 Length = Limit - DiscWinLength;
+	if(Length > READAHEAD_CHUNK)
+		Length = READAHEAD_CHUNK;
+	if(RealDI_DriveRead(DiscWinLength, Length, false))
+		DiscWinLength += Length;
+	else //probably the end of the disc
+		DiscWinAhead = false;
 }
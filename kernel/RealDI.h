@@ -29,5 +29,7 @@ void RealDI_Identify(bool NeedsGC);
 bool RealDI_NewDisc();
 void ClearRealDiscBuffer(void);
 const u8 *ReadRealDisc(u32 *Length, u32 Offset, bool NeedSync);
+bool RealDI_PrefetchPending(void);
+void RealDI_Prefetch(void);
 
 #endif
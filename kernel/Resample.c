@@ -0,0 +1,126 @@
+// Nintendont (kernel): 48 kHz to 32 kHz resampler for streamed audio.
+// Polyphase FIR: the input is upsampled by 2 and every third sample is
+// kept, so only the taps that hit real input frames are computed. The
+// 16 tap least-squares lowpass (pass to 12.5 kHz, stop from 20 kHz,
+// weighted most near 48 kHz where the images of low tones fall) is split
+// into 2 phases of 8 taps, 14 fractional bits, each phase summing to 1.0.
+//
+// A stereo frame is handled as one 32 bit word, so each input word is
+// loaded once for both channels and each output is a single store. The
+// second phase is the first one reversed, so the taps pack in pairs into
+// RESAMPLE_TAPS / 2 words, and every product is a 16x16 multiply-add on
+// the halves of two words: one SMLA<x><y> on ARMv5TE. The result is
+// clamped with two QADDs. The C versions of both give the same output.
+
+#include "Resample.h"
+
+// Taps i and RESAMPLE_TAPS - 1 - i of the first phase in one word, tap i
+// in the low half. The first phase, newest input frame first, is
+//   55, -849, -1058, 7129, 10626, 2300, -1736, -83
+#define RESAMPLE_PAIR(lo, hi)	(((unsigned int)(hi) << 16) | ((lo) & 0xFFFF))
+
+static const unsigned int ResampleCoef[RESAMPLE_TAPS / 2] =
+{
+	RESAMPLE_PAIR(55, -83),
+	RESAMPLE_PAIR(-849, -1736),
+	RESAMPLE_PAIR(-1058, 2300),
+	RESAMPLE_PAIR(7129, 10626),
+};
+
+#ifdef __ARM_FEATURE_DSP
+// acc += half of a * half of b; B is the bottom half, T the top one.
+#define RESAMPLE_MLA(xy, acc, a, b) \
+	__asm__ ("smla" xy "\t%0, %1, %2, %0" : "+r" (acc) : "r" (a), "r" (b))
+// v = v * 4, saturated to 32 bits.
+#define RESAMPLE_SAT4(v) \
+	__asm__ ("qadd\t%0, %0, %0\n\tqadd\t%0, %0, %0" : "+r" (v))
+#else
+#define RESAMPLE_HALF_B(v)	((int)(short)(v))
+#define RESAMPLE_HALF_T(v)	((int)(v) >> 16)
+#define RESAMPLE_MLA(xy, acc, a, b) \
+	((acc) += ((xy)[0] == 'b' ? RESAMPLE_HALF_B(a) : RESAMPLE_HALF_T(a)) * \
+		((xy)[1] == 'b' ? RESAMPLE_HALF_B(b) : RESAMPLE_HALF_T(b)))
+#define RESAMPLE_SAT4(v) \
+	((v) = (v) > 0x1FFFFFFF ? 0x7FFFFFFF : ((v) < -0x20000000 ? -0x7FFFFFFF - 1 : (v) * 4))
+#endif
+
+void ResampleReset(Resampler *r)
+{
+	unsigned int i;
+	for (i = 0; i < RESAMPLE_TAPS - 1 + RESAMPLE_MAX_IN; i++)
+		r->Buf[i] = 0;
+	// Start with a full history of silence.
+	r->Fill = RESAMPLE_TAPS - 1;
+	r->Next = (RESAMPLE_TAPS - 1) * 2;
+}
+
+short *ResampleInput(Resampler *r)
+{
+	return (short *)(r->Buf + r->Fill);
+}
+
+// One output frame from the frames ending at x, newest first. The
+// second phase uses the tap pairs the other way round.
+static inline unsigned int ResampleDot(unsigned int phase, const unsigned int *x)
+{
+	int lo = 1 << 13, hi = 1 << 13, i;
+	for (i = 0; i < RESAMPLE_TAPS / 2; i++)
+	{
+		unsigned int a = x[-i], b = x[i + 1 - RESAMPLE_TAPS], k = ResampleCoef[i];
+		if (phase == 0)
+		{
+			RESAMPLE_MLA("bb", lo, a, k);
+			RESAMPLE_MLA("tb", hi, a, k);
+			RESAMPLE_MLA("bt", lo, b, k);
+			RESAMPLE_MLA("tt", hi, b, k);
+		}
+		else
+		{
+			RESAMPLE_MLA("bt", lo, a, k);
+			RESAMPLE_MLA("tt", hi, a, k);
+			RESAMPLE_MLA("bb", lo, b, k);
+			RESAMPLE_MLA("tb", hi, b, k);
+		}
+	}
+	// Back from 14 fractional bits to the top half, clamped.
+	RESAMPLE_SAT4(lo);
+	RESAMPLE_SAT4(hi);
+	return ((unsigned int)hi & 0xFFFF0000) | ((unsigned int)lo >> 16);
+}
+
+unsigned int Resample48to32(Resampler *r, unsigned int frames, short *out)
+{
+	unsigned int *buf = r->Buf;
+	unsigned int *o = (unsigned int *)out;
+	unsigned int i, keep, fill, next;
+
+	fill = r->Fill + frames;
+
+	// next is the newest frame used by an output, in half frames.
+	next = r->Next;
+	while ((next >> 1) < fill)
+	{
+		const unsigned int *x = buf + (next >> 1);
+		if ((next & 1) == 0 && (next >> 1) + 1 < fill)
+		{
+			// Both outputs of a group of 3 frames.
+			o[0] = ResampleDot(0, x);
+			o[1] = ResampleDot(1, x + 1);
+			o += 2;
+			next += 6;
+		}
+		else
+		{
+			*o++ = ResampleDot(next & 1, x);
+			next += 3;
+		}
+	}
+
+	// Keep the history the next outputs need.
+	keep = (next >> 1) - (RESAMPLE_TAPS - 1);
+	for (i = 0; i < fill - keep; i++)
+		buf[i] = buf[keep + i];
+	r->Fill = fill - keep;
+	r->Next = next - keep * 2;
+	return o - (unsigned int *)out;
+}
@@ -0,0 +1,43 @@
+// Nintendont (kernel): 48 kHz to 32 kHz resampler for streamed audio.
+// Plain C with no kernel dependencies, so it can be checked on the host.
+
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+// Filter taps per output sample.
+#define RESAMPLE_TAPS		8
+// Most input frames passed in one call.
+#define RESAMPLE_MAX_IN		28
+
+typedef struct _Resampler
+{
+	unsigned int Buf[RESAMPLE_TAPS - 1 + RESAMPLE_MAX_IN];	// stereo input frames, oldest first
+	unsigned int Fill;	// frames in Buf
+	unsigned int Next;	// position of the next output, in half input frames
+} Resampler;
+
+/**
+ * Clear the filter state, for the start of a stream.
+ * @param r Resampler.
+ */
+void ResampleReset(Resampler *r);
+
+/**
+ * Where the next input goes: room for RESAMPLE_MAX_IN interleaved
+ * stereo frames, 4 byte aligned. Decode straight into it.
+ * @param r Resampler.
+ * @return Input buffer.
+ */
+short *ResampleInput(Resampler *r);
+
+/**
+ * Resample the frames written to ResampleInput() from 48 kHz to 32 kHz.
+ * Every 3 input frames give 2 output frames; the state carries over.
+ * @param r Resampler.
+ * @param frames Number of input frames, at most RESAMPLE_MAX_IN.
+ * @param out Output frames, 4 byte aligned, room for (frames * 2 + 2) / 3 of them.
+ * @return Number of output frames.
+ */
+unsigned int Resample48to32(Resampler *r, unsigned int frames, short *out);
+
+#endif /* __RESAMPLE_H__ */
@@ -48,7 +48,11 @@ static u8 __sd0_cid[16];
  
 static s32 __sdio_initialized;
 
+// Reads bounce one sector, __sd0_sethighspeed() uses two.
+#define RW_BUFFER_SECTORS	2
 static u8 *rw_buffer;
+
+static SDIOStats SDStats;
  
 static char _sd0_fs[] = "/dev/sdio/slot0";
 
@@ -251,6 +255,59 @@ static s32 __sd0_setbuswidth(u32 bus_width)
 
 	return ret;
 }
+/**
+ * Switch the card to high-speed mode (CMD6) and the host to 50 MHz.
+ * Falls back to the default clock if the card can't do it or sector 0
+ * doesn't read back the same at the higher clock.
+ * The card has to be selected.
+ * @return 1 if high-speed mode is active; 0 if not.
+ */
+static s32 __sd0_sethighspeed()
+{
+	s32 ret;
+	u32 hc_reg = 0;
+	u8 *sw = rw_buffer;
+	u8 *check = rw_buffer + PAGE_SIZE512;
+
+	// function group 1, function 1 is high speed
+	sync_before_read( sw, SDIO_SWITCH_STATUS_SIZE );
+	_ahbMemFlush(9);
+	ret = __sdio_sendcommand(SDIO_CMD_SWITCHFUNC, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, SDIO_SWITCH_CHECK_HS, 1, SDIO_SWITCH_STATUS_SIZE, sw, NULL, 0);
+	if(ret < 0 || !(sw[13] & 0x02))
+		return 0;
+
+	sync_before_read( sw, SDIO_SWITCH_STATUS_SIZE );
+	_ahbMemFlush(9);
+	ret = __sdio_sendcommand(SDIO_CMD_SWITCHFUNC, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, SDIO_SWITCH_SET_HS, 1, SDIO_SWITCH_STATUS_SIZE, sw, NULL, 0);
+	if(ret < 0 || (sw[16] & 0xF) != 1)
+		return 0;
+
+	// reference copy of sector 0 at the default clock
+	sync_before_read( check, PAGE_SIZE512 );
+	_ahbMemFlush(9);
+	ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, 0, 1, PAGE_SIZE512, check, NULL, 0);
+	if(ret < 0)
+		return 0;
+
+	ret = __sdio_gethcr(SDIOHCR_HOSTCONTROL, 1, &hc_reg);
+	if(ret < 0)
+		return 0;
+	hc_reg &= 0xff;
+	__sdio_sethcr(SDIOHCR_HOSTCONTROL, 1, hc_reg | SDIOHCR_HOSTCONTROL_HS);
+	__sdio_setclock(0); // no divider, 48 MHz base clock
+
+	sync_before_read( sw, PAGE_SIZE512 );
+	_ahbMemFlush(9);
+	ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, 0, 1, PAGE_SIZE512, sw, NULL, 0);
+	if(ret >= 0 && memcmp(sw, check, PAGE_SIZE512) == 0)
+		return 1;
+
+	dbgprintf("SD:High speed read back failed\r\n");
+	__sdio_sethcr(SDIOHCR_HOSTCONTROL, 1, hc_reg);
+	__sdio_setclock(1);
+	return 0;
+}
+
 static s32 __sd0_getcid()
 {
 	s32 ret;
@@ -273,7 +330,7 @@ s32 SDHCInit()
 	__sd0_sdhc = 0;
 	__sdio_initialized = 0;
 
-	rw_buffer = (u8*)malloc( 128 * PAGE_SIZE512 ); //64KB
+	rw_buffer = (u8*)malloc( RW_BUFFER_SECTORS * PAGE_SIZE512 );
 
 	dbgprintf("SD:Heap:%X\r\n", rw_buffer );
 
@@ -383,6 +440,10 @@ s32 SDHCInit()
 		ret = __sd0_deselect();
 		return false;
 	}
+
+	memset32(&SDStats, 0, sizeof(SDIOStats));
+	SDStats.HighSpeed = __sd0_sethighspeed();
+	dbgprintf("SD:High speed:%u\r\n", SDStats.HighSpeed);
 	__sd0_deselect();
 
 	__sd0_initialized = 1;
@@ -403,11 +464,31 @@ void SDHCShutdown( void )
 	__sd0_fd = -1;
 }
 
+/**
+ * Read sectors into a 32-byte aligned buffer with a single command.
+ * The card has to be selected.
+ * @param sector First sector.
+ * @param numSectors Number of sectors.
+ * @param dst Destination, 32-byte aligned.
+ * @return >= 0 on success; negative on error.
+ */
+static s32 __sd0_readblocks(sec_t sector, sec_t numSectors, u8 *dst)
+{
+	if(__sd0_sdhc == 0)
+		sector *= PAGE_SIZE512;
+
+	sync_before_read( dst, numSectors * PAGE_SIZE512 );
+	_ahbMemFlush(9);
+
+	SDStats.Commands++;
+	return __sdio_sendcommand( SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, sector, numSectors, PAGE_SIZE512, dst, NULL, 0 );
+}
+
 bool sdio_ReadSectors(sec_t sector, sec_t numSectors, void* buffer )
 {
 	s32 ret;
-	u8 *ptr;
-	sec_t blk_off;
+	u8 *ptr = (u8*)buffer;
+	u32 shift;
 
 	if(buffer==NULL)
 		return false;
@@ -416,53 +497,37 @@ bool sdio_ReadSectors(sec_t sector, sec_t numSectors, void* buffer )
 	if(ret<0)
 		return false;
 
-	if((u32)buffer & 0x1F)
+	SDStats.Sectors += numSectors;
+	shift = (u32)buffer & 0x1F;
+	if(shift == 0)
 	{
-		ptr = (u8*)buffer;
-
-		int secs_to_read;
-
-		while( numSectors > 0 )
+		ret = __sd0_readblocks( sector, numSectors, ptr );
+		SDStats.Direct += numSectors;
+	}
+	else
+	{
+		// The DMA target has to be aligned, so everything after the first
+		// sector lands shift bytes early, inside the buffer, and is moved
+		// up into place. Only the first sector goes through rw_buffer,
+		// last, since the early copy overlaps its tail.
+		ret = 0;
+		if(numSectors > 1)
 		{
-			if(__sd0_sdhc == 0)
-				blk_off = (sector*PAGE_SIZE512);
-			else
-				blk_off = sector;
-
-			if(numSectors > 128)
-				secs_to_read = 128;
-			else
-				secs_to_read = numSectors;
-
-			sync_before_read( rw_buffer, secs_to_read * 512 );
-			_ahbMemFlush(9);
-
-			ret = __sdio_sendcommand( SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, blk_off, secs_to_read, PAGE_SIZE512, rw_buffer, NULL, 0 );
+			u8 *aligned = ptr + PAGE_SIZE512 - shift;
+			ret = __sd0_readblocks( sector + 1, numSectors - 1, aligned );
 			if( ret >= 0 )
-			{
-				memcpy( ptr, rw_buffer, PAGE_SIZE512*secs_to_read );
-				sync_after_write( ptr, PAGE_SIZE512*secs_to_read );
-
-				ptr			+= PAGE_SIZE512*secs_to_read;
-				sector		+= secs_to_read;
-				numSectors	-= secs_to_read;
-
-			} else
-				break;
+				memmove( ptr + PAGE_SIZE512, aligned, (numSectors - 1) * PAGE_SIZE512 );
+			SDStats.Shifted += numSectors - 1;
+		}
+		if( ret >= 0 )
+		{
+			ret = __sd0_readblocks( sector, 1, rw_buffer );
+			if( ret >= 0 )
+				memcpy( ptr, rw_buffer, PAGE_SIZE512 );
+			SDStats.Bounced++;
 		}
-	} else {
-
-		if(__sd0_sdhc == 0)
-			sector *= PAGE_SIZE512;
-		
-		sync_before_read( buffer, numSectors * PAGE_SIZE512 );
-		_ahbMemFlush(9);
-
-		ret = __sdio_sendcommand( SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC, SDIO_RESPONSE_R1, sector, numSectors, PAGE_SIZE512, buffer, NULL, 0 );
-	
-		sync_after_write( buffer, numSectors * PAGE_SIZE512 );
-
 	}
+	sync_after_write( ptr, numSectors * PAGE_SIZE512 );
 
 	__sd0_deselect();
 
@@ -493,8 +558,8 @@ bool sdio_WriteSectors(sec_t sector, sec_t numSectors,const void* buffer)
 				blk_off = (sector*PAGE_SIZE512);
 			else
 				blk_off = sector;
-			if(numSectors > 128)
-				secs_to_write = 128;
+			if(numSectors > RW_BUFFER_SECTORS)
+				secs_to_write = RW_BUFFER_SECTORS;
 			else
 				secs_to_write = numSectors;
 
@@ -528,3 +593,8 @@ bool sdio_WriteSectors(sec_t sector, sec_t numSectors,const void* buffer)
 
 	return (ret>=0);
 }
+
+void sdio_GetStats(SDIOStats *stats)
+{
+	memcpy(stats, &SDStats, sizeof(SDIOStats));
+}
@@ -13,6 +13,7 @@
 #define	SDIOHCR_SOFTWARERESET		0x2f
  
 #define SDIOHCR_HOSTCONTROL_4BIT	0x02
+#define SDIOHCR_HOSTCONTROL_HS		0x04
 
 #define	SDIO_DEFAULT_TIMEOUT		0xe
  
@@ -48,6 +49,7 @@
 #define SDIO_CMD_GOIDLE				0x00
 #define	SDIO_CMD_ALL_SENDCID		0x02
 #define SDIO_CMD_SENDRCA			0x03
+#define SDIO_CMD_SWITCHFUNC			0x06
 #define SDIO_CMD_SELECT				0x07
 #define SDIO_CMD_DESELECT			0x07
 #define	SDIO_CMD_SENDIFCOND			0x08
@@ -96,9 +98,25 @@ struct _sdiomsg //just there for easy alignment
 	struct _sdioresponse response;
 };
 
+// CMD6 arguments: query, then switch function group 1 to high speed.
+#define SDIO_SWITCH_CHECK_HS		0x00FFFFF1
+#define SDIO_SWITCH_SET_HS			0x80FFFFF1
+#define SDIO_SWITCH_STATUS_SIZE		64
+
+typedef struct _SDIOStats
+{
+	u32 Commands;	// read commands sent to the card
+	u32 Sectors;	// sectors read
+	u32 Direct;		// sectors DMAed straight into the caller's buffer
+	u32 Shifted;	// sectors DMAed into an unaligned buffer and moved into place
+	u32 Bounced;	// sectors copied through the bounce buffer
+	u32 HighSpeed;	// card and host run in high-speed mode
+} SDIOStats;
+
 s32 SDHCInit( void );
 void SDHCShutdown( void );
 bool sdio_ReadSectors(sec_t sector, sec_t numSectors,void* buffer);
 bool sdio_WriteSectors(sec_t sector, sec_t numSectors,const void* buffer);
+void sdio_GetStats(SDIOStats *stats);
 
 #endif
@@ -20,6 +20,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "Stream.h"
 #include "string.h"
 #include "adp.h"
+#include "Resample.h"
 #include "DI.h"
 extern int dbgprintf( const char *fmt, ...);
 static u32 StreamEnd = 0;
@@ -29,7 +30,18 @@ u32 StreamStart = 0;
 u32 StreamCurrent = 0;
 static u32 StreamLoop = 0;
 
+// ADP data is read ahead by the DI thread into a ring of chunks,
+// so slow devices don't hold up the main loop.
+#define STREAM_SLOTS 4
+#define STREAM_SLOT_SIZE 0x5400 // CHUNK_48to32
 static u8 *const StreamBuffer = (u8*)0x132A0000;
+static u32 SlotOffset[STREAM_SLOTS];	// disc offset
+static u32 SlotLength[STREAM_SLOTS];	// chunk size when it was read
+static u32 SlotValid[STREAM_SLOTS];	// bytes before the stream end
+static u32 StreamHead = 0;	// next slot to decode
+static u32 StreamFilled = 0;	// slots with data
+static bool StreamReading = false;	// read into the slot after them
+static u32 StreamFetch = 0;	// next disc offset to read, 0 for none
 
 #define AI_CR 0x0D806C00
 #define AI_32K (1<<6)
@@ -44,19 +56,24 @@ static u32 buf2 = 0x1328C400;
 static u32 cur_buf = 0;
 static u32 buf_loc = 0;
 
-static s16 outl[SAMPLES_PER_BLOCK], outr[SAMPLES_PER_BLOCK];
-static long hist[4];
+// Short looping streams are kept decoded after the first pass, and
+// later passes are copied from here with no disc reads or decoding.
+// Decoder state is reset after the last chunk of every pass, so each
+// pass decodes the same as the first.
+static u8 *StreamCache = NULL;
+static u32 StreamCacheMax = 0;	// chunks that fit
+static u32 CacheStart = 0, CacheSize = 0;	// stream being cached
+static u32 CacheChunkSize = 0;	// ADP bytes per chunk, set by the sample rate
+static u32 CacheChunks = 0;	// chunks decoded so far
+static bool CacheDone = false;	// the whole loop is decoded
+static u32 StreamChunk = 0;	// chunk of the pass being played
 
-static u32 samplecounter = 0;
-static s16 samplebufferL = 0, samplebufferR = 0;
+static int hist[4];
+
+static Resampler Resamp;
 static PCMWriter CurrentWriter;
 void StreamInit()
 {
-	memset(outl, 0, sizeof(outl));
-	sync_after_write(outl, sizeof(outl));
-	memset(outr, 0, sizeof(outr));
-	sync_after_write(outl, sizeof(outl));
-
 	memset32((void*)buf1, 0, BUFSIZE);
 	sync_after_write((void*)buf1, BUFSIZE);
 	memset32((void*)buf2, 0, BUFSIZE);
@@ -71,9 +88,7 @@ void StreamPrepare()
 		//dbgprintf("Using 48kHz ADP -> 32kHz PCM Decoder\n");
 		CurrentWriter = WritePCM48to32;
 		cur_chunksize = CHUNK_48to32;
-		samplecounter = 0;
-		samplebufferL = 0;
-		samplebufferR = 0;
+		ResampleReset(&Resamp);
 	}
 	else
 	{
@@ -83,74 +98,226 @@ void StreamPrepare()
 	}
 }
 
-static inline void write16INC(u32 buf, u32 *loc, s16 val)
+void StreamUpdate(const u8 *Chunk)
 {
-	write16(buf+(*loc), val);
-	*loc += 2;
+	buf_loc = 0;
+	u32 i;
+	for(i = 0; i < cur_chunksize; i += ONE_BLOCK_SIZE)
+		CurrentWriter(Chunk+i);
+	sync_after_write((void*)cur_buf, BUFSIZE);
+	cur_buf = (cur_buf == buf1) ? buf2 : buf1;
+}
+
+void WritePCM48to32(const u8 *Block)
+{	/* a chunk always gives exactly BUFSIZE, 2 frames for every 3 */
+	ADPDecodeBlock(Block, ResampleInput(&Resamp), hist);
+	buf_loc += Resample48to32(&Resamp, SAMPLES_PER_BLOCK, (s16*)(cur_buf + buf_loc)) * 4;
+}
+
+void WritePCM48(const u8 *Block)
+{	/* no resampling, decode right into the output buffer */
+	ADPDecodeBlock(Block, (s16*)(cur_buf + buf_loc), hist);
+	buf_loc += SAMPLES_PER_BLOCK * 4;
 }
-static inline void SaveSamples(const u32 j, s16 *bufl, s16 *bufr)
+
+u32 StreamGetChunkSize()
 {
-	samplebufferL = bufl[j];
-	samplebufferR = bufr[j];
+	return cur_chunksize;
 }
-static inline void CombineSamples(const u32 j, s16 *bufl, s16 *bufr)
-{	/* average samples to keep quality about the same */
-	bufl[j] = (bufl[j] + samplebufferL)>>1;
-	bufr[j] = (bufr[j] + samplebufferR)>>1;
+
+static inline u8 *StreamSlot(u32 Slot)
+{
+	return StreamBuffer + Slot * STREAM_SLOT_SIZE;
 }
-void StreamUpdate()
+
+/**
+ * Start reading the next chunk, if there is room for it.
+ */
+static void StreamReadAhead()
 {
-	buf_loc = 0;
-	u32 i;
-	for(i = 0; i < cur_chunksize; i += ONE_BLOCK_SIZE)
+	if(StreamReading)
 	{
-		//outl and outr needed to be swapped here to be correct
-		// coverity[swapped_arguments]
-		ADPdecodebuffer(StreamBuffer+i,outr,outl,&hist[0],&hist[1],&hist[2],&hist[3]);
-		CurrentWriter();
+		if(!DIStreamReadDone())
+			return;
+		StreamReading = false;
+		StreamFilled++;
 	}
-	sync_after_write((void*)cur_buf, BUFSIZE);
-	cur_buf = (cur_buf == buf1) ? buf2 : buf1;
+	if(StreamFetch == 0 || StreamFilled == STREAM_SLOTS)
+		return;
+
+	u32 Slot = (StreamHead + StreamFilled) % STREAM_SLOTS;
+	u32 Length = StreamGetChunkSize();
+	SlotOffset[Slot] = StreamFetch;
+	SlotLength[Slot] = Length;
+	SlotValid[Slot] = Length;
+	if(StreamFetch + Length > StreamEndOffset)
+		SlotValid[Slot] = (StreamEndOffset > StreamFetch) ? StreamEndOffset - StreamFetch : 0;
+	DIStartStreamRead((u32)StreamSlot(Slot), StreamFetch, Length);
+	StreamReading = true;
+
+	StreamFetch += Length;
+	if(StreamFetch >= StreamEndOffset) //keep reading from the loop start
+		StreamFetch = StreamLoop ? StreamStart : 0;
 }
 
-void WritePCM48to32()
+/**
+ * Drop the chunks read so far and continue reading at Offset.
+ * @param Offset Disc offset, 0 to stop reading.
+ */
+static void StreamRestart(u32 Offset)
 {
-	unsigned int j;
-	for(j = 0; j < SAMPLES_PER_BLOCK; j++)
+	if(StreamReading)
+		DIFinishStreamRead();
+	StreamReading = false;
+	StreamFilled = 0;
+	StreamFetch = Offset;
+}
+
+/**
+ * Set up the decoded stream cache.
+ * @param Area MEM2 area, NULL to disable.
+ * @param Size Size of the area.
+ */
+void StreamSetCache(u8 *Area, u32 Size)
+{
+	StreamCache = Area;
+	StreamCacheMax = Area ? Size / BUFSIZE : 0;
+	CacheStart = CacheSize = CacheChunkSize = 0;
+	CacheChunks = 0;
+	CacheDone = false;
+}
+
+/**
+ * Check the cache against the current stream and sample rate,
+ * and start over if they changed. Called at the start of a pass.
+ */
+static void StreamCacheCheck()
+{
+	if(StreamCache == NULL)
+		return;
+	u32 ChunkSize = StreamGetChunkSize();
+	if(CacheStart == StreamStart && CacheSize == StreamSize && CacheChunkSize == ChunkSize)
 	{
-		samplecounter++;
-		if(samplecounter == 2)
-		{
-			SaveSamples(j, outl, outr);
-			continue;
-		}
-		if(samplecounter == 3)
-		{
-			CombineSamples(j, outl, outr);
-			samplecounter = 0;
-		}
-		write16INC(cur_buf, &buf_loc, outl[j]);
-		write16INC(cur_buf, &buf_loc, outr[j]);
+		if(!CacheDone)	//only a full pass from the start is kept
+			CacheChunks = 0;
+		return;
 	}
+	CacheStart = StreamStart;
+	CacheSize = StreamSize;
+	CacheChunkSize = ChunkSize;
+	CacheChunks = 0;
+	CacheDone = false;
+	if((StreamSize + ChunkSize - 1) / ChunkSize > StreamCacheMax)
+		CacheChunkSize = 0;	//too long, play it from disc
+}
+
+static inline bool StreamCached()
+{
+	return CacheDone && CacheChunkSize == StreamGetChunkSize();
 }
 
-void WritePCM48()
+/**
+ * Copy the next chunk of a cached loop into the current PCM buffer.
+ */
+static void StreamCopyNext()
 {
-	unsigned int j;
-	for(j = 0; j < SAMPLES_PER_BLOCK; j++)
+	memcpy((void*)cur_buf, StreamCache + StreamChunk * BUFSIZE, BUFSIZE);
+	sync_after_write((void*)cur_buf, BUFSIZE);
+	cur_buf = (cur_buf == buf1) ? buf2 : buf1;
+
+	StreamChunk++;
+	StreamCurrent += StreamGetChunkSize();
+	if(StreamChunk == CacheChunks)
 	{
-		write16INC(cur_buf, &buf_loc, outl[j]);
-		write16INC(cur_buf, &buf_loc, outr[j]);
+		StreamChunk = 0;
+		if(StreamLoop == 1)
+		{
+			StreamCurrent = StreamStart;
+			StreamPrepare();
+			StreamCacheCheck();
+			if(!StreamCached()) //sample rate changed
+				StreamRestart(StreamStart);
+		}
+		else
+			StreamEnd = 1;
 	}
 }
 
-u32 StreamGetChunkSize()
+/**
+ * Decode the next chunk into the current PCM buffer.
+ */
+static void StreamDecodeNext()
 {
-	return cur_chunksize;
+	if(StreamCached())
+	{
+		StreamCopyNext();
+		return;
+	}
+	if(StreamFilled == 0 && StreamReading)
+	{	//underrun, wait for the read
+		DIFinishStreamRead();
+		StreamReadAhead();
+	}
+	if(StreamFilled == 0 || SlotLength[StreamHead] != StreamGetChunkSize())
+	{	//nothing read, or read for another sample rate
+		StreamRestart(StreamFilled ? SlotOffset[StreamHead] : StreamCurrent);
+		StreamReadAhead();
+		DIFinishStreamRead();
+		StreamReadAhead();
+		if(StreamFilled == 0)
+			return;
+	}
+	u32 Slot = StreamHead;
+	u8 *Chunk = StreamSlot(Slot);
+	StreamHead = (StreamHead + 1) % STREAM_SLOTS;
+	StreamFilled--;
+
+	bool PassEnd = false;
+	StreamCurrent = SlotOffset[Slot] + SlotLength[Slot];
+	if(StreamCurrent >= StreamEndOffset) //terrible loop but it works
+	{
+		u32 diff = SlotLength[Slot] - SlotValid[Slot];
+		memset32(Chunk + SlotValid[Slot], 0, diff);
+		PassEnd = true;
+	}
+	u32 Out = cur_buf;
+	StreamUpdate(Chunk);
+
+	if(CacheChunkSize == SlotLength[Slot] && CacheChunks == StreamChunk && CacheChunks < StreamCacheMax)
+	{
+		memcpy(StreamCache + CacheChunks * BUFSIZE, (void*)Out, BUFSIZE);
+		CacheChunks++;
+	}
+	StreamChunk++;
+	if(!PassEnd)
+		return;
+
+	if(CacheChunks == StreamChunk)
+		CacheDone = true;
+	StreamChunk = 0;
+	if(StreamLoop == 1)
+	{	//the next pass starts from fresh decoder state, like the first
+		u32 ChunkSize = StreamGetChunkSize();
+		StreamCurrent = StreamStart;
+		StreamPrepare();
+		StreamCacheCheck();
+		if(StreamCached()) //the rest comes from the cache
+			StreamRestart(0);
+		else if(ChunkSize != StreamGetChunkSize())
+			StreamRestart(StreamStart);
+	}
+	else
+	{
+		StreamEnd = 1;
+		StreamRestart(0);
+	}
 }
 
 void StreamUpdateRegisters()
 {
+	if(StreamCurrent > 0)
+		StreamReadAhead();
+
 	sync_before_read((void*)UPDATE_STREAM, 0x20);
 	if(read32(UPDATE_STREAM))		//decoder update, it WILL update
 	{
@@ -163,22 +330,8 @@ void StreamUpdateRegisters()
 		}
 		else if(StreamCurrent > 0)
 		{
-			DiscReadSync((u32)StreamBuffer, StreamCurrent, StreamGetChunkSize(), 1);
-			StreamCurrent += StreamGetChunkSize();
-			if(StreamCurrent >= StreamEndOffset) //terrible loop but it works
-			{
-				u32 diff = StreamCurrent - StreamEndOffset;
-				u32 startpos = StreamGetChunkSize() - diff;
-				memset32(StreamBuffer + startpos, 0, diff);
-				if(StreamLoop == 1)
-				{
-					StreamCurrent = StreamStart;
-					StreamPrepare();
-				}
-				else
-					StreamEnd = 1;
-			}
-			StreamUpdate();
+			StreamDecodeNext();
+			StreamReadAhead();
 		}
 		write32(UPDATE_STREAM, 0); //clear status
 		sync_after_write((void*)UPDATE_STREAM, 0x20);
@@ -194,14 +347,15 @@ void StreamStartStream(u32 CurrentStart, u32 CurrentSize)
 		StreamCurrent = StreamStart;
 		StreamEndOffset = StreamStart + StreamSize;
 		StreamPrepare();
-		DiscReadSync((u32)StreamBuffer, StreamCurrent, StreamGetChunkSize(), 1);
-		StreamCurrent += StreamGetChunkSize();
+		StreamLoop = 1;
+		StreamChunk = 0;
+		StreamCacheCheck();
+		StreamRestart(StreamCached() ? 0 : StreamCurrent);
 		cur_buf = buf1; //reset adp buffer
-		StreamUpdate();
+		StreamDecodeNext();
 		/* Directly read in the second buffer */
-		DiscReadSync((u32)StreamBuffer, StreamCurrent, StreamGetChunkSize(), 1);
-		StreamCurrent += StreamGetChunkSize();
-		StreamUpdate();
+		StreamDecodeNext();
+		StreamReadAhead();
 		/* Send stream signal to PPC */
 		write32(AI_ADP_LOC, 0); //reset adp read pos
 		write32(UPDATE_STREAM, 0); //clear status
@@ -218,6 +372,7 @@ void StreamStartStream(u32 CurrentStart, u32 CurrentSize)
 void StreamEndStream()
 {
 	StreamCurrent = 0;
+	StreamFetch = 0; //the ring is dropped on the next start
 	write32(STREAMING, 0); //clear stream flag
 	sync_after_write((void*)STREAMING, 0x20);
 }
@@ -28,17 +28,21 @@ enum
 	SAMPLES_PER_BLOCK = 28
 };
 
+// Decoded DTK loop cache, taken from the ISO cache when enabled.
+#define STREAM_CACHE_SIZE	0x200000
+
 void StreamInit();
+void StreamSetCache(u8 *Area, u32 Size);
 void StreamStartStream(u32 CurrentStart, u32 CurrentSize);
 void StreamEndStream();
 void StreamUpdateRegisters();
 void StreamPrepare();
-void StreamUpdate();
+void StreamUpdate(const u8 *Chunk);
 u32 StreamGetChunkSize();
 
-typedef void (*PCMWriter)();
-void WritePCM48to32();
-void WritePCM48();
+typedef void (*PCMWriter)(const u8 *Block);
+void WritePCM48to32(const u8 *Block);
+void WritePCM48(const u8 *Block);
 
 #endif
 
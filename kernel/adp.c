@@ -11,54 +11,63 @@
 // uses same algorithm as XA, apparently
 // ADP decoder function by hcs, reversed from dtkmake (trkmake v1.4)
 
+#include "adp.h"
+
 #define ONE_BLOCK_SIZE		32
 #define SAMPLES_PER_BLOCK	28
 
-short ADPDecodeSample( int bits, int q, long * hist1p, long * hist2p) {
-	long hist=0,cur;
-	long hist1=*hist1p,hist2=*hist2p;
+// Prediction filters, indexed by the high nibble of the block header.
+// Only 0-3 are used by the encoder, the rest predict silence.
+static const int ADPFilter[16][2] =
+{
+	{ 0x00,  0x00 }, { 0x3c,  0x00 }, { 0x73, -0x34 }, { 0x62, -0x37 },
+	{ 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 },
+	{ 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 },
+	{ 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 }, { 0x00,  0x00 },
+};
 
-	switch( q >> 4 )
-	{
-		case 0:
-			hist = 0;
-			break;
-		case 1:
-			hist = (hist1 * 0x3c);
-			break;
-		case 2:
-			hist = (hist1 * 0x73) - (hist2 * 0x34);
-			break;
-		case 3:
-			hist = (hist1 * 0x62) - (hist2 * 0x37);
-			break;
-		//default:
-		//	hist = (q>>4)*hist1+(q>>4)*hist2; // a bit weird but it's in the code, never used
-	}
-	hist=(hist+0x20)>>6;
-	if (hist >  0x1fffff) hist= 0x1fffff;
-	if (hist < -0x200000) hist=-0x200000;
+// The history keeps 6 fractional bits and is not clamped to 16 bits,
+// so it needs full 32-bit multiplies.
+#define ADP_PREDICT(c1, c2, h1, h2, p) \
+	p = ((c1) * (h1) + (c2) * (h2) + 0x20) >> 6; \
+	if (p >  0x1fffff) p =  0x1fffff; \
+	if (p < -0x200000) p = -0x200000;
 
-	cur = ( ( (short)(bits << 12) >> (q & 0xf)) << 6) + hist;
-	
-	*hist2p = *hist1p;
-	*hist1p = cur;
+#define ADP_CLAMP16(v) \
+	((v) < -0x8000 ? -0x8000 : ((v) > 0x7fff ? 0x7fff : (v)))
 
-	cur>>=6;
+void ADPDecodeBlock(const unsigned char *input, short *pcm, int *hist)
+{
+	// Left is stored in the high nibbles, right in the low ones.
+	const int lc1 = ADPFilter[input[1] >> 4][0], lc2 = ADPFilter[input[1] >> 4][1];
+	const int rc1 = ADPFilter[input[0] >> 4][0], rc2 = ADPFilter[input[0] >> 4][1];
+	const int lshift = input[1] & 0xf, rshift = input[0] & 0xf;
+	int l1 = hist[2], l2 = hist[3];
+	int r1 = hist[0], r2 = hist[1];
+	const unsigned char *data = input + (ONE_BLOCK_SIZE - SAMPLES_PER_BLOCK);
+	int i;
 
-	if ( cur < -0x8000 ) return -0x8000;
-	if ( cur >  0x7fff ) return  0x7fff;
+	for (i = 0; i < SAMPLES_PER_BLOCK; i++)
+	{
+		const int bits = data[i];
+		int p, cur;
 
-	return (short)cur;
-}
+		// Sign extended nibble, scaled to the top of a halfword.
+		ADP_PREDICT(lc1, lc2, l1, l2, p);
+		cur = ((((int)((unsigned)bits << 24) >> 28) << 12 >> lshift) << 6) + p;
+		l2 = l1;
+		l1 = cur;
+		cur >>= 6;
+		pcm[i * 2] = ADP_CLAMP16(cur);
 
-// decode 32 bytes of input (28 samples), assume stereo
-int ADPdecodebuffer(unsigned char *input, short *outl, short * outr, long *histl1, long *histl2, long *histr1, long *histr2) {
-	int i;
-	for( i = 0; i < SAMPLES_PER_BLOCK; i++ )
-	{
-		outl[i] = ADPDecodeSample( input[i + (ONE_BLOCK_SIZE - SAMPLES_PER_BLOCK)] & 0xf, input[0], histl1, histl2 );
-		outr[i] = ADPDecodeSample( input[i + (ONE_BLOCK_SIZE - SAMPLES_PER_BLOCK)] >> 4, input[1], histr1, histr2 );
+		ADP_PREDICT(rc1, rc2, r1, r2, p);
+		cur = ((((int)((unsigned)bits << 28) >> 28) << 12 >> rshift) << 6) + p;
+		r2 = r1;
+		r1 = cur;
+		cur >>= 6;
+		pcm[i * 2 + 1] = ADP_CLAMP16(cur);
 	}
-	return 0;
+
+	hist[0] = r1; hist[1] = r2;
+	hist[2] = l1; hist[3] = l2;
 }
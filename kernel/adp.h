@@ -14,7 +14,12 @@
 // uses same algorithm as XA, apparently
 // ADP decoder function by hcs, reversed from dtkmake (trkmake v1.4)
 
-// decode 32 bytes of input (28 samples), assume stereo
-int ADPdecodebuffer(unsigned char *input, short *outl, short * outr, long *histl1, long *histl2, long *histr1, long *histr2);
+/**
+ * Decode one stereo block: 32 bytes of input, 28 samples per channel.
+ * @param input ADP block.
+ * @param pcm Output, 28 interleaved left/right sample pairs.
+ * @param hist Decoder history: right channel in 0-1, left channel in 2-3.
+ */
+void ADPDecodeBlock(const unsigned char *input, short *pcm, int *hist);
 
 #endif
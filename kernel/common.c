@@ -2,6 +2,8 @@
 #include "global.h"
 #include "EXI.h"
 #include "Config.h"
+#include "DI.h"
+#include "DITrace.h"
 #include "debug.h"
 
 //#include <ctype.h> //somehow broke in devkitARM r46
@@ -147,8 +149,11 @@ extern bool isWiiVC;
 void Shutdown( void )
 {
 	dbgprintf("Got Shutdown button call\n");
+	DIFinishAsync();
 	if( ConfigGetConfig(NIN_CFG_MEMCARDEMU) )
 		EXIShutdown();
+	DITrace_Save();
+	LogFlush();
 
 #if 0
 
@@ -18,6 +18,7 @@
 #include "common.h"
 
 extern bool access_led;
+extern u32 USBReadTimer;
 u32 s_size;	// Sector size.
 u32 s_cnt;	// Sector count.
 
@@ -140,6 +141,9 @@ DRESULT disk_read_usb (
 	//turn off drive led
 	if (access_led) clear32(HW_GPIO_OUT, GPIO_SLOT_LED);
 
+	//refresh keep-alive timeout
+	USBReadTimer = read32(HW_TIMER);
+
 	return RES_OK;
 }
 
@@ -171,6 +175,9 @@ DRESULT disk_write_usb (
 	//turn off drive led
 	if (access_led) clear32(HW_GPIO_OUT, GPIO_SLOT_LED);
 
+	//refresh keep-alive timeout
+	USBReadTimer = read32(HW_TIMER);
+
 	return RES_OK;
 }
 
@@ -236,6 +236,7 @@ typedef struct PADStatus
 #define PAD_BUTTON_MENU         0x1000
 #define PAD_BUTTON_START        0x1000
 
+#ifndef NIN_HOST_REPLAY
 static inline u16 read16(u32 addr)
 {
 	u32 data;
@@ -298,6 +299,16 @@ static inline u32 clear32(u32 addr, u32 clear)
 	);
 	return data;
 }
+#else
+// Host replay build (kernel/replay): hardware and low memory are emulated.
+u16 read16(u32 addr);
+void write16(u32 addr, u16 data);
+u32 read32(u32 addr);
+void write32(u32 addr, u32 data);
+u32 set32(u32 addr, u32 set);
+u32 mask32(u32 addr, u32 clear, u32 set);
+u32 clear32(u32 addr, u32 clear);
+#endif /* NIN_HOST_REPLAY */
 
 static inline u32 TicksToSecs(u32 time)
 {
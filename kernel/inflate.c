@@ -0,0 +1,416 @@
+// Nintendont (kernel): zlib/DEFLATE decompressor.
+// Used by ISO.c for compressed disc images.
+//
+// Canonical Huffman decoding as described in RFC 1951.
+// Codes up to INF_FAST_BITS long are resolved with a single
+// table lookup; longer codes fall back to a bit-by-bit walk.
+
+#include "inflate.h"
+#include "string.h"
+
+#define INF_MAX_BITS	15
+#define INF_FAST_BITS	9
+#define INF_FAST_MASK	((1 << INF_FAST_BITS) - 1)
+
+typedef struct _HuffTree
+{
+	u16 counts[INF_MAX_BITS + 1];	// number of codes of each length
+	u16 symbols[288];		// symbols ordered by code
+	u16 fast[1 << INF_FAST_BITS];	// (length << 12) | symbol; 0 = slow path
+} HuffTree;
+
+// Decoder state. Kept static; the DI thread stack is small.
+static struct
+{
+	const u8 *src;
+	const u8 *srcEnd;
+	u32 bitbuf;
+	u32 bitcnt;
+	u32 error;
+	u8 *dst;
+	u8 *dstStart;
+	u8 *dstEnd;
+} inf;
+
+static HuffTree LitTree, DistTree;
+static HuffTree FixedLit, FixedDist;
+static u32 FixedReady = 0;
+
+static const u16 LenBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const u8 LenExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const u16 DistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577 };
+static const u8 DistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const u8 CodeLenOrder[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+/**
+ * Top up the bit buffer to at least 'need' bits, if input remains.
+ * @param need Number of bits wanted. (max 25)
+ */
+static inline void inf_fill(u32 need)
+{
+	while (inf.bitcnt < need && inf.src < inf.srcEnd)
+	{
+		inf.bitbuf |= (u32)(*inf.src++) << inf.bitcnt;
+		inf.bitcnt += 8;
+	}
+}
+
+/**
+ * Read bits from the stream, LSB first.
+ * Running out of input sets the error flag.
+ * @param need Number of bits. (max 16)
+ * @return Bits.
+ */
+static u32 inf_bits(u32 need)
+{
+	u32 val;
+	if (need == 0)
+		return 0;
+	inf_fill(need);
+	if (inf.bitcnt < need)
+	{
+		inf.error = 1;
+		return 0;
+	}
+	val = inf.bitbuf & ((1 << need) - 1);
+	inf.bitbuf >>= need;
+	inf.bitcnt -= need;
+	return val;
+}
+
+/**
+ * Build a canonical Huffman tree from code lengths.
+ * @param h       [out] Tree.
+ * @param lengths [in]  Code length of each symbol.
+ * @param n       [in]  Number of symbols.
+ * @return 0 if complete; >0 if incomplete; <0 if over-subscribed.
+ */
+static s32 inf_build(HuffTree *h, const u8 *lengths, u32 n)
+{
+	u16 offs[INF_MAX_BITS + 1];
+	u32 len, sym, code, idx, i, k;
+	s32 left;
+
+	// An empty tree must not decode with a previous tree's table.
+	memset32(h->counts, 0, sizeof(h->counts));
+	memset32(h->fast, 0, sizeof(h->fast));
+	for (sym = 0; sym < n; sym++)
+		h->counts[lengths[sym]]++;
+	if (h->counts[0] == n)
+		return 0;
+
+	left = 1;
+	for (len = 1; len <= INF_MAX_BITS; len++)
+	{
+		left <<= 1;
+		left -= h->counts[len];
+		if (left < 0)
+			return left;
+	}
+
+	offs[1] = 0;
+	for (len = 1; len < INF_MAX_BITS; len++)
+		offs[len + 1] = offs[len] + h->counts[len];
+	for (sym = 0; sym < n; sym++)
+	{
+		if (lengths[sym] != 0)
+			h->symbols[offs[lengths[sym]]++] = sym;
+	}
+
+	// Short codes get every table slot whose low bits match
+	// the bit-reversed code.
+	code = 0;
+	idx = 0;
+	for (len = 1; len <= INF_FAST_BITS; len++)
+	{
+		for (i = 0; i < h->counts[len]; i++, code++, idx++)
+		{
+			u32 rev = 0, c = code;
+			for (k = 0; k < len; k++, c >>= 1)
+				rev = (rev << 1) | (c & 1);
+			for (k = rev; k < (1 << INF_FAST_BITS); k += 1 << len)
+				h->fast[k] = (len << 12) | h->symbols[idx];
+		}
+		code <<= 1;
+	}
+	return left;
+}
+
+/**
+ * Decode one symbol.
+ * @param h Tree.
+ * @return Symbol, or -1 on error.
+ */
+static s32 inf_decode(const HuffTree *h)
+{
+	s32 code, first, count, index;
+	u32 len, e;
+
+	inf_fill(16);
+	e = h->fast[inf.bitbuf & INF_FAST_MASK];
+	len = e >> 12;
+	if (len != 0 && len <= inf.bitcnt)
+	{
+		inf.bitbuf >>= len;
+		inf.bitcnt -= len;
+		return e & 0xFFF;
+	}
+
+	code = first = index = 0;
+	for (len = 1; len <= INF_MAX_BITS; len++)
+	{
+		code |= inf_bits(1);
+		if (inf.error)
+			return -1;
+		count = h->counts[len];
+		if (code - count < first)
+			return h->symbols[index + (code - first)];
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+/**
+ * Copy a stored block.
+ * @return 0 on success; -1 on error.
+ */
+static s32 inf_stored(void)
+{
+	u32 len, nlen;
+
+	// Drop to a byte boundary and hand back any whole bytes
+	// that were already pulled into the bit buffer.
+	inf.bitbuf >>= inf.bitcnt & 7;
+	inf.bitcnt &= ~7;
+	inf.src -= inf.bitcnt >> 3;
+	inf.bitbuf = 0;
+	inf.bitcnt = 0;
+
+	if (inf.srcEnd - inf.src < 4)
+		return -1;
+	len = inf.src[0] | (inf.src[1] << 8);
+	nlen = inf.src[2] | (inf.src[3] << 8);
+	inf.src += 4;
+	if (len != (~nlen & 0xFFFF))
+		return -1;
+	if ((u32)(inf.srcEnd - inf.src) < len || (u32)(inf.dstEnd - inf.dst) < len)
+		return -1;
+	memcpy(inf.dst, inf.src, len);
+	inf.src += len;
+	inf.dst += len;
+	return 0;
+}
+
+/**
+ * Decode the compressed data of a block.
+ * @param lit  Literal/length tree.
+ * @param dist Distance tree.
+ * @return 0 on success; -1 on error.
+ */
+static s32 inf_codes(const HuffTree *lit, const HuffTree *dist)
+{
+	s32 sym;
+	u32 len, d;
+
+	while (1)
+	{
+		sym = inf_decode(lit);
+		if (sym < 0)
+			return -1;
+		if (sym < 256)
+		{
+			if (inf.dst == inf.dstEnd)
+				return -1;
+			*inf.dst++ = sym;
+			continue;
+		}
+		if (sym == 256)
+			return 0;
+
+		sym -= 257;
+		if (sym >= 29)
+			return -1;
+		len = LenBase[sym] + inf_bits(LenExtra[sym]);
+
+		sym = inf_decode(dist);
+		if (sym < 0 || sym >= 30)
+			return -1;
+		d = DistBase[sym] + inf_bits(DistExtra[sym]);
+		if (inf.error)
+			return -1;
+		if (d > (u32)(inf.dst - inf.dstStart) || len > (u32)(inf.dstEnd - inf.dst))
+			return -1;
+
+		// Overlapping copies are how DEFLATE encodes runs,
+		// so this has to go forward one byte at a time.
+		{
+			const u8 *from = inf.dst - d;
+			u8 *to = inf.dst;
+			inf.dst += len;
+			do {
+				*to++ = *from++;
+			} while (--len);
+		}
+	}
+}
+
+/**
+ * Decode a block with the fixed Huffman codes.
+ * @return 0 on success; -1 on error.
+ */
+static s32 inf_fixed(void)
+{
+	if (!FixedReady)
+	{
+		u8 lengths[288];
+		u32 sym;
+		for (sym = 0; sym < 144; sym++)
+			lengths[sym] = 8;
+		for (; sym < 256; sym++)
+			lengths[sym] = 9;
+		for (; sym < 280; sym++)
+			lengths[sym] = 7;
+		for (; sym < 288; sym++)
+			lengths[sym] = 8;
+		inf_build(&FixedLit, lengths, 288);
+		for (sym = 0; sym < 30; sym++)
+			lengths[sym] = 5;
+		inf_build(&FixedDist, lengths, 30);
+		FixedReady = 1;
+	}
+	return inf_codes(&FixedLit, &FixedDist);
+}
+
+/**
+ * Decode a block with dynamic Huffman codes.
+ * @return 0 on success; -1 on error.
+ */
+static s32 inf_dynamic(void)
+{
+	static u8 lengths[320];
+	u32 nlen, ndist, ncode, index;
+	s32 sym, err;
+
+	nlen = inf_bits(5) + 257;
+	ndist = inf_bits(5) + 1;
+	ncode = inf_bits(4) + 4;
+	if (inf.error || nlen > 286 || ndist > 30)
+		return -1;
+
+	for (index = 0; index < ncode; index++)
+		lengths[CodeLenOrder[index]] = inf_bits(3);
+	for (; index < 19; index++)
+		lengths[CodeLenOrder[index]] = 0;
+	if (inf.error || inf_build(&LitTree, lengths, 19) != 0)
+		return -1;
+
+	index = 0;
+	while (index < nlen + ndist)
+	{
+		u32 len, rep;
+		sym = inf_decode(&LitTree);
+		if (sym < 0)
+			return -1;
+		if (sym < 16)
+		{
+			lengths[index++] = sym;
+			continue;
+		}
+		len = 0;
+		if (sym == 16)
+		{
+			if (index == 0)
+				return -1;
+			len = lengths[index - 1];
+			rep = 3 + inf_bits(2);
+		}
+		else if (sym == 17)
+			rep = 3 + inf_bits(3);
+		else
+			rep = 11 + inf_bits(7);
+		if (inf.error || index + rep > nlen + ndist)
+			return -1;
+		while (rep--)
+			lengths[index++] = len;
+	}
+	if (lengths[256] == 0)
+		return -1;
+
+	// Incomplete codes are only allowed for a single length.
+	err = inf_build(&LitTree, lengths, nlen);
+	if (err < 0 || (err > 0 && nlen - LitTree.counts[0] != 1))
+		return -1;
+	err = inf_build(&DistTree, lengths + nlen, ndist);
+	if (err < 0 || (err > 0 && ndist - DistTree.counts[0] != 1))
+		return -1;
+
+	return inf_codes(&LitTree, &DistTree);
+}
+
+/**
+ * Decompress a zlib stream.
+ * The Adler-32 trailer is not verified.
+ * @param dst    [out] Destination buffer.
+ * @param dstLen [in]  Size of the destination buffer.
+ * @param src    [in]  zlib stream.
+ * @param srcLen [in]  Size of the zlib stream.
+ * @return Number of bytes written on success; negative on error.
+ */
+s32 inflate_zlib(u8 *dst, u32 dstLen, const u8 *src, u32 srcLen)
+{
+	u32 last, type;
+	s32 ret;
+
+	// CMF/FLG: deflate, no preset dictionary.
+	if (srcLen < 2 || (src[0] & 0x0F) != 8 || (src[1] & 0x20) ||
+	    ((src[0] << 8) | src[1]) % 31 != 0)
+		return -1;
+
+	inf.src = src + 2;
+	inf.srcEnd = src + srcLen;
+	inf.bitbuf = 0;
+	inf.bitcnt = 0;
+	inf.error = 0;
+	inf.dst = dst;
+	inf.dstStart = dst;
+	inf.dstEnd = dst + dstLen;
+
+	do {
+		last = inf_bits(1);
+		type = inf_bits(2);
+		if (inf.error)
+			return -1;
+		switch (type)
+		{
+			case 0:
+				ret = inf_stored();
+				break;
+			case 1:
+				ret = inf_fixed();
+				break;
+			case 2:
+				ret = inf_dynamic();
+				break;
+			default:
+				ret = -1;
+				break;
+		}
+		if (ret < 0 || inf.error)
+			return -1;
+	} while (!last);
+
+	return inf.dst - inf.dstStart;
+}
@@ -0,0 +1,20 @@
+// Nintendont (kernel): zlib/DEFLATE decompressor.
+// Used by ISO.c for compressed disc images.
+
+#ifndef __INFLATE_H__
+#define __INFLATE_H__
+
+#include "global.h"
+
+/**
+ * Decompress a zlib stream.
+ * The Adler-32 trailer is not verified.
+ * @param dst    [out] Destination buffer.
+ * @param dstLen [in]  Size of the destination buffer.
+ * @param src    [in]  zlib stream.
+ * @param srcLen [in]  Size of the zlib stream.
+ * @return Number of bytes written on success; negative on error.
+ */
+s32 inflate_zlib(u8 *dst, u32 dstLen, const u8 *src, u32 srcLen);
+
+#endif /* __INFLATE_H__ */
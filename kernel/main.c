@@ -38,6 +38,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "GCAM.h"
 #include "TRI.h"
 #include "Patch.h"
+#include "DITrace.h"
+#include "Idle.h"
 
 #include "diskio.h"
 #include "usbstorage.h"
@@ -59,7 +61,6 @@ static const WCHAR fatDevName[2] = { 0x002F, 0x0000 };
 extern u32 SI_IRQ;
 extern bool DI_IRQ, EXI_IRQ;
 extern u32 WaitForRealDisc;
-extern struct ipcmessage DI_CallbackMsg;
 extern u32 DI_MessageQueue;
 extern vu32 DisableSIPatch;
 extern vu32 bbaEmuWanted;
@@ -249,6 +250,8 @@ int _main( int argc, char *argv[] )
 
 	TRIInit();
 
+	DITrace_Init();
+
 	EXIInit();
 
 	BootStatus(11, s_size, s_cnt);
@@ -281,7 +284,7 @@ int _main( int argc, char *argv[] )
 #endif
 	USBReadTimer = Now;
 	u32 Reset = 0;
-	bool SaveCard = false;
+	IdleInit(UseUSB);
 
 	//enable ios led use
 	access_led = ConfigGetConfig(NIN_CFG_LED);
@@ -375,29 +378,14 @@ int _main( int argc, char *argv[] )
 			else if(!bbaEmuWanted)
 				udelay(200); //let the driver load data
 		}
-		else if(SaveCard == true) /* DI IRQ indicates we might read async, so dont write at the same time */
-		{
-			if(TimerDiffSeconds(Now) > 2) /* after 3 second earliest */
-			{
-				GCNCard_Save();
-				SaveCard = false;
-			}
-		}
-		else if(UseUSB && TimerDiffSeconds(USBReadTimer) > 149) /* Read random sector every 2 mins 30 secs */
-		{
-			DIFinishAsync(); //if something is still running
-			DI_CallbackMsg.result = -1;
-			sync_after_write(&DI_CallbackMsg, 0x20);
-			IOS_IoctlAsync( DI_Handle, 2, NULL, 0, NULL, 0, DI_MessageQueue, &DI_CallbackMsg );
-			DIFinishAsync();
-			USBReadTimer = read32(HW_TIMER);
-		}
-		else /* No device I/O so make sure this stays updated */
+		/* DI IRQ indicates we might read async, so only do other work without it */
+		else if(IdleRun() == false) /* No device I/O so make sure this stays updated */
 			GetCurrentTime();
 		udelay(20); //wait for other threads
 
 		if( WaitForRealDisc == 1 )
 		{
+			DIFinishPrefetch(); //drive has to be idle
 			if(RealDI_NewDisc())
 			{
 				DiscChangeTimer = read32(HW_TIMER);
@@ -454,10 +442,7 @@ int _main( int argc, char *argv[] )
 		StreamUpdateRegisters();
 		CheckOSReport();
 		if(GCNCard_CheckChanges())
-		{
-			Now = read32(HW_TIMER);
-			SaveCard = true;
-		}
+			IdleCardChanged();
 		sync_before_read((void*)RESET_STATUS, 0x20);
 		vu32 reset_status = read32(RESET_STATUS);
 		if (reset_status == 0x1DEA)
@@ -471,6 +456,7 @@ int _main( int argc, char *argv[] )
 			if (Reset == 0)
 			{
 				dbgprintf("Fake Reset IRQ\r\n");
+				IdleCardSync(); //memcard may not get another chance
 				write32( RSW_INT, 0x2 ); // Reset irq
 				sync_after_write( (void*)RSW_INT, 0x20 );
 				write32(HW_IPC_ARMCTRL, 8); //throw irq
@@ -543,6 +529,16 @@ int _main( int argc, char *argv[] )
 	if( ConfigGetConfig(NIN_CFG_MEMCARDEMU) )
 		EXIShutdown();
 
+	DITrace_Save();
+
+	if(!UseUSB)
+	{
+		SDIOStats sds;
+		sdio_GetStats(&sds);
+		dbgprintf("SD:Read commands:%u sectors:%u direct:%u shifted:%u bounced:%u high speed:%u\r\n",
+			sds.Commands, sds.Sectors, sds.Direct, sds.Shifted, sds.Bounced, sds.HighSpeed);
+	}
+
 	if (ConfigGetConfig(NIN_CFG_LOG))
 		closeLog();
 
@@ -0,0 +1,218 @@
+// Nintendont (kernel): host ADP decoder check.
+// Compares ADPDecodeBlock() against the original sample-at-a-time
+// decoder, checks a fixed stream against its known output, and
+// times both.
+//
+//   make -C kernel/replay adpbench
+//   kernel/replay/adpbench [blocks]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adp.h"
+
+#define ONE_BLOCK_SIZE		32
+#define SAMPLES_PER_BLOCK	28
+
+// Output hash of GoldenStream(), from the original decoder.
+#define GOLDEN_BLOCKS		4096
+#define GOLDEN_HASH		0x2e1c8c13u
+
+// The original decoder, as the reference.
+static short RefDecodeSample(int bits, int q, int *hist1p, int *hist2p)
+{
+	int hist = 0, cur;
+	int hist1 = *hist1p, hist2 = *hist2p;
+
+	switch (q >> 4)
+	{
+		case 0:
+			hist = 0;
+			break;
+		case 1:
+			hist = (hist1 * 0x3c);
+			break;
+		case 2:
+			hist = (hist1 * 0x73) - (hist2 * 0x34);
+			break;
+		case 3:
+			hist = (hist1 * 0x62) - (hist2 * 0x37);
+			break;
+	}
+	hist = (hist + 0x20) >> 6;
+	if (hist >  0x1fffff) hist =  0x1fffff;
+	if (hist < -0x200000) hist = -0x200000;
+
+	cur = (((short)(bits << 12) >> (q & 0xf)) << 6) + hist;
+
+	*hist2p = *hist1p;
+	*hist1p = cur;
+
+	cur >>= 6;
+
+	if (cur < -0x8000) return -0x8000;
+	if (cur >  0x7fff) return  0x7fff;
+
+	return (short)cur;
+}
+
+// Same argument order as Stream.c used: right channel first.
+static void RefDecodeBlock(const unsigned char *input, short *pcm, int *hist)
+{
+	int i;
+	for (i = 0; i < SAMPLES_PER_BLOCK; i++)
+	{
+		const unsigned char bits = input[i + (ONE_BLOCK_SIZE - SAMPLES_PER_BLOCK)];
+		pcm[i * 2 + 1] = RefDecodeSample(bits & 0xf, input[0], &hist[0], &hist[1]);
+		pcm[i * 2] = RefDecodeSample(bits >> 4, input[1], &hist[2], &hist[3]);
+	}
+}
+
+static unsigned int Seed = 1;
+static unsigned int Rand(void)
+{
+	Seed = Seed * 1103515245 + 12345;
+	return Seed >> 8;
+}
+
+// Filters 0-3 with a realistic shift mix, plus the odd unused filter.
+static void GoldenStream(unsigned char *buf, unsigned int blocks)
+{
+	unsigned int i, j;
+	Seed = 0x44545321;
+	for (i = 0; i < blocks; i++)
+	{
+		unsigned char *b = buf + i * ONE_BLOCK_SIZE;
+		for (j = 0; j < 2; j++)
+		{
+			unsigned int filter = (Rand() % 17 == 0) ? Rand() & 15 : Rand() & 3;
+			unsigned int shift = Rand() % 13;
+			b[j] = (filter << 4) | shift;
+		}
+		b[2] = b[0];
+		b[3] = b[1];
+		for (j = 4; j < ONE_BLOCK_SIZE; j++)
+			b[j] = Rand();
+	}
+}
+
+static unsigned int Hash(const short *pcm, unsigned int count, unsigned int h)
+{
+	unsigned int i;
+	for (i = 0; i < count; i++)
+	{
+		h = (h ^ (pcm[i] & 0xff)) * 16777619u;
+		h = (h ^ ((pcm[i] >> 8) & 0xff)) * 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Decode a stream with both decoders and compare every sample.
+ * @return Number of mismatching blocks.
+ */
+static unsigned int Compare(const unsigned char *buf, unsigned int blocks, int *hist, unsigned int *hash)
+{
+	short ref[SAMPLES_PER_BLOCK * 2], out[SAMPLES_PER_BLOCK * 2];
+	int rhist[4];
+	unsigned int i, bad = 0;
+
+	memcpy(rhist, hist, sizeof(rhist));
+	for (i = 0; i < blocks; i++)
+	{
+		RefDecodeBlock(buf + i * ONE_BLOCK_SIZE, ref, rhist);
+		ADPDecodeBlock(buf + i * ONE_BLOCK_SIZE, out, hist);
+		if (memcmp(ref, out, sizeof(ref)) != 0 || memcmp(rhist, hist, sizeof(rhist)) != 0)
+		{
+			if (bad == 0)
+				printf("  first mismatch in block %u\n", i);
+			bad++;
+			memcpy(hist, rhist, sizeof(rhist));
+		}
+		if (hash)
+			*hash = Hash(ref, SAMPLES_PER_BLOCK * 2, *hash);
+	}
+	return bad;
+}
+
+static double Seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int blocks = (argc > 1) ? strtoul(argv[1], NULL, 0) : 0x40000;
+	unsigned char block[ONE_BLOCK_SIZE];
+	unsigned char *buf;
+	short pcm[SAMPLES_PER_BLOCK * 2];
+	unsigned int i, bad = 0, hash;
+	int hist[4];
+	volatile int sink = 0;
+	double t;
+
+	if (blocks < GOLDEN_BLOCKS)
+		blocks = GOLDEN_BLOCKS;
+	buf = malloc(blocks * ONE_BLOCK_SIZE);
+	if (!buf)
+		return 1;
+
+	// Every header pair, from random and from saturated history.
+	Seed = 7;
+	for (i = 0; i < 0x10000 * 2; i++)
+	{
+		unsigned int j;
+		block[0] = block[2] = i & 0xff;
+		block[1] = block[3] = (i >> 8) & 0xff;
+		for (j = 4; j < ONE_BLOCK_SIZE; j++)
+			block[j] = Rand();
+		for (j = 0; j < 4; j++)
+		{
+			if (i < 0x10000)
+				hist[j] = (int)(Rand() % 0x800000) - 0x400000;
+			else
+				hist[j] = (Rand() & 1) ? 0x3fffff : -0x400000;
+		}
+		bad += Compare(block, 1, hist, NULL);
+	}
+	printf("headers:  %s\n", bad ? "FAIL" : "ok");
+
+	// Fixed stream against the known output.
+	GoldenStream(buf, GOLDEN_BLOCKS);
+	memset(hist, 0, sizeof(hist));
+	hash = 2166136261u;
+	i = Compare(buf, GOLDEN_BLOCKS, hist, &hash);
+	bad += i;
+	printf("golden:   %s (hash %08x)\n", (i == 0 && hash == GOLDEN_HASH) ? "ok" : "FAIL", hash);
+	if (hash != GOLDEN_HASH)
+		bad++;
+
+	// Speed, on a long stream.
+	GoldenStream(buf, blocks);
+	memset(hist, 0, sizeof(hist));
+	t = Seconds();
+	for (i = 0; i < blocks; i++)
+	{
+		RefDecodeBlock(buf + i * ONE_BLOCK_SIZE, pcm, hist);
+		sink += pcm[0];
+	}
+	t = Seconds() - t;
+	printf("original: %8.2f MB/s\n", blocks * ONE_BLOCK_SIZE / t / 1048576);
+
+	memset(hist, 0, sizeof(hist));
+	t = Seconds();
+	for (i = 0; i < blocks; i++)
+	{
+		ADPDecodeBlock(buf + i * ONE_BLOCK_SIZE, pcm, hist);
+		sink += pcm[0];
+	}
+	t = Seconds() - t;
+	printf("block:    %8.2f MB/s\n", blocks * ONE_BLOCK_SIZE / t / 1048576);
+
+	free(buf);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+// Nintendont (kernel): host replay build.
+// Force-included into the kernel sources built by kernel/replay.
+// Routes the kernel's libc replacements to the emulated memory in shim.c.
+
+#ifndef __REPLAY_HOST_H__
+#define __REPLAY_HOST_H__
+
+#define memcpy		HostMemcpy
+#define memset		HostMemset
+#define memset32	HostMemset32
+#define malloc		HostMalloc
+#define malloca		HostMalloca
+#define free		HostFree
+
+#endif /* __REPLAY_HOST_H__ */
@@ -0,0 +1,579 @@
+// Nintendont (kernel): host replay build.
+// Replays a DI read trace (see DITrace.h) against a local disc image
+// using the kernel's ISO.c, FST.c and ReadSpeed.c, and reports how
+// the cache, prefetch and read speed emulation behave. The data of
+// each read is checked against the image or the extracted files, and
+// replay exits with 1 if any of it differs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "global.h"
+#include "CommonConfig.h"
+#include "DI.h"
+#include "ISO.h"
+#include "FST.h"
+#include "ReadSpeed.h"
+#include "DITrace.h"
+#include "replay.h"
+
+// Kernel state normally owned by DI.c and friends.
+u8 *const DI_READ_BUFFER = (u8*)0x12E80000;
+const u32 DI_READ_BUFFER_LENGTH = 0x80000;
+u64 ISOShift64 = 0;
+u32 DiscRequested = 0;
+u32 TRIGame = 0;
+u32 TITLE_ID = 0;
+u32 RealDiscCMD = 0;
+u32 BI2region = 0;
+bool wiiVCInternal = false;
+extern u32 UseReadLimit;
+extern u32 FSTMode;
+
+// Same place as the kernel's Config.h; replay.c is built against the
+// host libc, so the kernel's libc headers are kept out.
+static NIN_CFG *const ncfg = (NIN_CFG*)0x13004000;
+
+// Stubs for kernel functions outside the disc readers.
+u32 GCNCard_GetTotalSize(void) { return 0; }
+void StreamSetCache(u8 *Area, u32 Size) { }
+s32 WDVD_FST_OpenDisc(u32 discNum) { return -1; }
+s32 WDVD_FST_LSeek(u32 pos) { return -1; }
+s32 WDVD_FST_Read(u8 *data, u32 size) { return -1; }
+s32 WDVD_FST_Close(void) { return 0; }
+
+// Game read destination in MEM1.
+#define REPLAY_DEST		0x00100000
+#define REPLAY_DEST_MAX		(HOST_MEM1_END - REPLAY_DEST)
+
+// Where the FST is placed for FST mode, like the apploader would.
+#define REPLAY_FST		0x01700000
+
+// ReadSpeed_End() polling step; about 8 us.
+#define REPLAY_POLL_TICKS	16
+
+typedef struct _ReplayStats
+{
+	u32 Requests;
+	u32 Hits;	// requests served without touching the backing store
+	u32 Clipped;	// requests larger than REPLAY_DEST_MAX
+	u64 Bytes;	// bytes requested by the game
+	u64 Latency;	// sum of request latencies, in ticks
+	u32 MaxLatency;
+	u32 Mismatches;	// requests whose data differs from the reference
+} ReplayStats;
+
+// Part of the disc backed by one file of an FST directory.
+typedef struct _ReplayFile
+{
+	u32 Offset;	// disc offset
+	u32 Length;	// disc range, zero filled past the end of the file
+	char Path[512];
+} ReplayFile;
+
+// Reference for checking the data of each read: an uncompressed
+// image, or the files of an FST directory.
+static int CheckFd = -1;
+static ReplayFile *CheckFiles = NULL;
+static u32 CheckFileCount = 0;
+static u8 *CheckBuf = NULL;
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [options] <trace> <image or FST directory>\n"
+		"  -s us    backing store seek time (default 8000)\n"
+		"  -b MB/s  backing store throughput (default 30)\n"
+		"  -F n     fragment the image every n 32 KB clusters\n"
+		"  -d disc  disc number to replay (default 0)\n"
+		"  -P file  preload the cache from this trace\n"
+		"  -c image check the data against this uncompressed image\n"
+		"           (default: the image itself unless compressed)\n"
+		"  -r       disable the disc read speed emulation\n"
+		"  -n       disable idle prefetch\n"
+		"  -q       print the summary only\n"
+		"  -v       print kernel debug output\n", argv0);
+}
+
+static inline u32 swap32(u32 v)
+{
+	return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+static inline u32 readbe32(const u8 *p)
+{
+	return ((u32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline bool host_le(void)
+{
+	const u32 one = 1;
+	return *(const u8*)&one == 1;
+}
+
+/**
+ * Load a trace file in host byte order.
+ * Traces written by the console are big-endian.
+ * @param path  Trace file.
+ * @param hdr   [out] Trace header.
+ * @return Records, or NULL on error.
+ */
+static DITraceRecord *LoadTrace(const char *path, DITraceHeader *hdr)
+{
+	FILE *f = fopen(path, "rb");
+	DITraceRecord *rec;
+	u32 i, swap;
+
+	if (f == NULL || fread(hdr, sizeof(*hdr), 1, f) != 1)
+	{
+		fprintf(stderr, "replay: unable to read %s\n", path);
+		if (f)
+			fclose(f);
+		return NULL;
+	}
+	swap = (hdr->Magic == swap32(DITRACE_MAGIC));
+	if (swap)
+	{
+		hdr->Magic = swap32(hdr->Magic);
+		hdr->Version = swap32(hdr->Version);
+		hdr->Count = swap32(hdr->Count);
+		hdr->Dropped = swap32(hdr->Dropped);
+	}
+	if (hdr->Magic != DITRACE_MAGIC || hdr->Version != DITRACE_VERSION)
+	{
+		fprintf(stderr, "replay: %s is not a DI trace\n", path);
+		fclose(f);
+		return NULL;
+	}
+
+	rec = calloc(hdr->Count ? hdr->Count : 1, sizeof(*rec));
+	hdr->Count = fread(rec, sizeof(*rec), hdr->Count, f);
+	fclose(f);
+	if (swap)
+	{
+		u32 *w = (u32*)rec;
+		for (i = 0; i < hdr->Count * (sizeof(*rec) / sizeof(u32)); i++)
+			w[i] = swap32(w[i]);
+	}
+	return rec;
+}
+
+/**
+ * Write a trace in host byte order for DITrace.c to preload from.
+ * @param path Trace file.
+ * @return Temporary file name, or NULL on error.
+ */
+static const char *PrepPreload(const char *path)
+{
+	static char tmpname[] = "/tmp/replay-preload-XXXXXX";
+	DITraceHeader hdr;
+	DITraceRecord *rec = LoadTrace(path, &hdr);
+	int fd;
+
+	if (rec == NULL)
+		return NULL;
+	fd = mkstemp(tmpname);
+	if (fd < 0 || write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    write(fd, rec, hdr.Count * sizeof(*rec)) != (ssize_t)(hdr.Count * sizeof(*rec)))
+	{
+		fprintf(stderr, "replay: unable to write %s\n", tmpname);
+		free(rec);
+		return NULL;
+	}
+	close(fd);
+	free(rec);
+	return tmpname;
+}
+
+/**
+ * Load sys/fst.bin into MEM1 and point low memory at it.
+ * FST.c parses the entries in place, so on a little-endian host they
+ * are stored in host order, with the type and name offset word laid
+ * out the way the compiler places the FEntry bitfields.
+ * @param dir FST directory.
+ * @return 0 on success; -1 on error.
+ */
+static int LoadFST(const char *dir)
+{
+	char path[512];
+	FILE *f;
+	size_t len;
+	u32 *w, i, Entries;
+
+	snprintf(path, sizeof(path), "%ssys/fst.bin", dir);
+	f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "replay: unable to open %s\n", path);
+		return -1;
+	}
+	len = fread(HostPtr(REPLAY_FST), 1, HOST_MEM1_END - REPLAY_FST, f);
+	fclose(f);
+	if (len < 0x0C)
+		return -1;
+	if (host_le())
+	{
+		w = HostPtr(REPLAY_FST);
+		Entries = swap32(w[2]);
+		if (Entries > len / 0x0C)
+			Entries = len / 0x0C;
+		for (i = 0; i < Entries * 3; i++)
+		{
+			w[i] = swap32(w[i]);
+			if (i % 3 == 0)
+				w[i] = (w[i] << 8) | (w[i] >> 24);	// Type:8, NameOffset:24
+		}
+	}
+	write32(0x38, 0x80000000 | REPLAY_FST);
+	return 0;
+}
+
+/**
+ * Add a file to the FST reference.
+ * @param Offset Disc offset.
+ * @param Length Disc range.
+ * @param dir FST directory.
+ * @param name Path relative to dir.
+ */
+static void CheckAddFile(u32 Offset, u32 Length, const char *dir, const char *name)
+{
+	ReplayFile *rf;
+
+	CheckFiles = realloc(CheckFiles, (CheckFileCount + 1) * sizeof(*CheckFiles));
+	rf = &CheckFiles[CheckFileCount++];
+	rf->Offset = Offset;
+	rf->Length = Length;
+	snprintf(rf->Path, sizeof(rf->Path), "%s%s", dir, name);
+}
+
+/**
+ * List the disc ranges of the files of an FST directory, straight from
+ * sys/boot.bin and sys/fst.bin rather than through FST.c.
+ * @param dir FST directory.
+ * @return 0 on success; -1 on error.
+ */
+static int CheckOpenFST(const char *dir)
+{
+	u32 Dol, Fst, FstSize, Entries, i, depth = 0;
+	u32 DirEnd[64];
+	size_t DirLen[64];
+	char path[512], name[512];
+	u8 hdr[0x0C], *fst;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%ssys/boot.bin", dir);
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0x420, SEEK_SET) != 0 || fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+	{
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	fclose(f);
+	Dol = readbe32(hdr);
+	Fst = readbe32(hdr + 4);
+	FstSize = readbe32(hdr + 8);
+
+	CheckAddFile(0, 0x440, dir, "sys/boot.bin");
+	CheckAddFile(0x440, 0x2000, dir, "sys/bi2.bin");
+	CheckAddFile(0x2440, Dol - 0x2440, dir, "sys/apploader.img");
+	CheckAddFile(Dol, Fst - Dol, dir, "sys/main.dol");
+	CheckAddFile(Fst, FstSize, dir, "sys/fst.bin");
+
+	snprintf(path, sizeof(path), "%ssys/fst.bin", dir);
+	f = fopen(path, "rb");
+	fst = calloc(FstSize + 1, 1);
+	if (f == NULL || fread(fst, 1, FstSize, f) != FstSize)
+	{
+		if (f)
+			fclose(f);
+		free(fst);
+		return -1;
+	}
+	fclose(f);
+	Entries = readbe32(fst + 8);
+	if (Entries > FstSize / 0x0C)
+		Entries = FstSize / 0x0C;
+
+	// Walk the tree in FST order, keeping the directory path in name.
+	name[0] = 0;
+	for (i = 1; i < Entries; i++)
+	{
+		const u8 *e = fst + i * 0x0C;
+		const char *n = (const char*)fst + Entries * 0x0C + (readbe32(e) & 0xFFFFFF);
+		size_t len;
+
+		while (depth > 0 && i >= DirEnd[depth - 1])
+			name[DirLen[--depth]] = 0;
+		len = strlen(name);
+		if (e[0] && depth < 64)
+		{
+			DirEnd[depth] = readbe32(e + 8);
+			DirLen[depth++] = len;
+			snprintf(name + len, sizeof(name) - len, "%s/", n);
+		}
+		else if (!e[0])
+		{
+			snprintf(path, sizeof(path), "root/%s%s", name, n);
+			CheckAddFile(readbe32(e + 4), readbe32(e + 8), dir, path);
+		}
+	}
+	free(fst);
+	return 0;
+}
+
+/**
+ * Open the reference for checking the data of each read.
+ * @param path Uncompressed image, or FST directory.
+ * @param Given Reference given on the command line, so it has to open.
+ * @return 1 if there is a reference; 0 if not; -1 on error.
+ */
+static int CheckOpen(const char *path, bool Given)
+{
+	struct stat st;
+	u8 magic[4];
+
+	if (!Given && FSTMode)
+		return CheckOpenFST(path) == 0 ? 1 : -1;
+	CheckFd = open(path, O_RDONLY);
+	if (CheckFd < 0 || fstat(CheckFd, &st) != 0 || !S_ISREG(st.st_mode))
+		return -1;
+	if (!Given && pread(CheckFd, magic, 4, 0) == 4 &&
+	    (readbe32(magic) == 0x4349534F || readbe32(magic) == 0x01C00BB1))
+	{
+		// CISO or GCZ: nothing to compare with.
+		close(CheckFd);
+		CheckFd = -1;
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Read the reference data for a request.
+ * @param Buffer Output buffer.
+ * @param Offset Disc offset.
+ * @param Length Length.
+ */
+static void CheckRead(u8 *Buffer, u32 Offset, u32 Length)
+{
+	ssize_t ret;
+	u32 i;
+
+	memset(Buffer, 0, Length);
+	if (CheckFd >= 0)
+	{
+		ret = pread(CheckFd, Buffer, Length, (off_t)Offset + ISOShift64);
+		(void)ret;	// short reads stay zero filled
+		return;
+	}
+	for (i = 0; i < CheckFileCount; i++)
+	{
+		const ReplayFile *rf = &CheckFiles[i];
+		u32 Start = Offset > rf->Offset ? Offset : rf->Offset;
+		u32 End = Offset + Length;
+		int fd;
+
+		if (rf->Offset + rf->Length < End)
+			End = rf->Offset + rf->Length;
+		if (Start >= End || (fd = open(rf->Path, O_RDONLY)) < 0)
+			continue;
+		ret = pread(fd, Buffer + (Start - Offset), End - Start, Start - rf->Offset);
+		close(fd);
+	}
+}
+
+/**
+ * Read a game request like the DI thread does.
+ * The data is compared with the reference, if there is one.
+ * @param Offset Disc offset.
+ * @param Length Length.
+ * @return true if the data matches the reference; false if not.
+ */
+static bool ReplayRead(u32 Offset, u32 Length)
+{
+	u8 *const dest = HostPtr(REPLAY_DEST);
+	const u8 *src;
+	u32 Pos, Len = Length;
+
+	for (Pos = 0; Pos < Length; Pos += Len)
+	{
+		Len = Length - Pos;
+		if (ISOReadTo(dest + Pos, &Len, Offset + Pos))
+			continue;
+		else
+			src = ISORead(&Len, Offset + Pos);
+		if (Len > Length - Pos)
+			Len = Length - Pos;
+		memcpy(dest + Pos, src, Len);
+	}
+	ReadSpeed_Setup(Offset, Length);
+	if (!FSTMode)
+		ISOPrefetchNote(Offset, Length);
+
+	if (CheckBuf == NULL)
+		return true;
+	CheckRead(CheckBuf, Offset, Length);
+	if (memcmp(CheckBuf, dest, Length) == 0)
+		return true;
+	for (Pos = 0; CheckBuf[Pos] == dest[Pos]; Pos++)
+		;
+	fprintf(stderr, "replay: data mismatch at %08X (read %08X, %X bytes)\n",
+		Offset + Pos, Offset, Length);
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	double SeekUs = 8000, MBps = 30;
+	bool Prefetch = true, Quiet = false;
+	const char *PreloadPath = NULL, *CheckPath = NULL;
+	DITraceHeader hdr;
+	DITraceRecord *rec;
+	ReplayStats st = {0};
+	u32 i;
+	int opt, Check;
+
+	while ((opt = getopt(argc, argv, "s:b:F:d:P:c:rnqv")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': SeekUs = atof(optarg); break;
+			case 'b': MBps = atof(optarg); break;
+			case 'F': HostFragClusters = atoi(optarg); break;
+			case 'd': DiscRequested = atoi(optarg); break;
+			case 'P': PreloadPath = optarg; break;
+			case 'c': CheckPath = optarg; break;
+			case 'r': UseReadLimit = 0; break;
+			case 'n': Prefetch = false; break;
+			case 'q': Quiet = true; break;
+			case 'v': HostVerbose = 1; break;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (argc - optind != 2 || MBps <= 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	HostSeekTicks = SeekUs * HOST_TICKS_PER_US;
+	HostByteTicks = HOST_TICKS_PER_US / MBps;
+	if (HostMemInit() != 0)
+		return 1;
+	rec = LoadTrace(argv[optind], &hdr);
+	if (rec == NULL)
+		return 1;
+	if (PreloadPath && (HostTracePath = PrepPreload(PreloadPath)) == NULL)
+		return 1;
+
+	// Open the image like the DI thread does.
+	snprintf(ncfg->GamePath, sizeof(ncfg->GamePath), "%s", argv[optind + 1]);
+	if (!ISOInit())
+	{
+		if (LoadFST(ncfg->GamePath) != 0 || !FSTInit(ncfg->GamePath))
+		{
+			fprintf(stderr, "replay: unable to open %s\n", ncfg->GamePath);
+			return 1;
+		}
+	}
+	Check = CheckOpen(CheckPath ? CheckPath : ncfg->GamePath, CheckPath != NULL);
+	if (Check < 0)
+	{
+		fprintf(stderr, "replay: unable to open %s for checking\n",
+			CheckPath ? CheckPath : ncfg->GamePath);
+		return 1;
+	}
+	if (Check)
+		CheckBuf = malloc(REPLAY_DEST_MAX);
+	TITLE_ID = read32(0) >> 8;
+	ReadSpeed_Init();
+	DITrace_Init();
+	ISOSetupCache();
+	HostIO.Bytes = HostIO.Reads = HostIO.Seeks = 0;
+	HostTicks = 0;
+
+	if (!Quiet)
+		printf("#   cmd   offset   length  backing seeks  latency(us)\n");
+	for (i = 0; i < hdr.Count; i++)
+	{
+		const u32 cmd = rec[i].Command & 0xFF;
+		u32 Length = rec[i].Length;
+		u64 Bytes;
+		u32 Seeks, Issue, Latency, Guard;
+
+		if ((cmd != 0xA8 && cmd != 0xF8) || ((rec[i].Command >> 8) & 0xFF) != DiscRequested)
+			continue;
+
+		// The DI thread reads ahead while the game is busy.
+		for (Guard = 0; Prefetch && !FSTMode && Guard < 0x10000 &&
+		     (s32)(HostTicks - rec[i].Time) < 0 && ISOPrefetchPending(); Guard++)
+			ISOPrefetch();
+
+		if ((s32)(HostTicks - rec[i].Time) < 0)
+			HostTicks = rec[i].Time;
+		Issue = HostTicks;
+		Bytes = HostIO.Bytes;
+		Seeks = HostIO.Seeks;
+		if (Length > REPLAY_DEST_MAX)
+		{
+			Length = REPLAY_DEST_MAX;
+			st.Clipped++;
+		}
+
+		if (cmd == 0xA8)
+			ReadSpeed_Start();
+		if (!ReplayRead(rec[i].Offset, Length))
+			st.Mismatches++;
+		if (cmd == 0xA8)
+		{
+			while (ReadSpeed_End() == 0)
+				HostTicks += REPLAY_POLL_TICKS;
+		}
+
+		Latency = HostTicks - Issue;
+		Bytes = HostIO.Bytes - Bytes;
+		Seeks = HostIO.Seeks - Seeks;
+		st.Requests++;
+		st.Bytes += Length;
+		st.Latency += Latency;
+		if (Latency > st.MaxLatency)
+			st.MaxLatency = Latency;
+		if (Bytes == 0)
+			st.Hits++;
+		if (!Quiet)
+			printf("%-5u %02X %08X %8X %8llu %5u %12.1f\n", i, cmd, rec[i].Offset, Length,
+				(unsigned long long)Bytes, Seeks, Latency / HOST_TICKS_PER_US);
+	}
+
+	if (FSTMode)
+		FSTCleanup();
+	else
+		ISOClose();
+	if (HostTracePath)
+		unlink(HostTracePath);
+
+	printf("requests:        %u (%u clipped)\n", st.Requests, st.Clipped);
+	printf("bytes requested: %llu\n", (unsigned long long)st.Bytes);
+	printf("cache hit rate:  %.1f%% (%u of %u)\n",
+		st.Requests ? 100.0 * st.Hits / st.Requests : 0.0, st.Hits, st.Requests);
+	printf("backing bytes:   %llu in %u reads\n", HostIO.Bytes, HostIO.Reads);
+	printf("backing seeks:   %u\n", HostIO.Seeks);
+	printf("latency (us):    avg %.1f, max %.1f, total %.1f\n",
+		st.Requests ? st.Latency / HOST_TICKS_PER_US / st.Requests : 0.0,
+		st.MaxLatency / HOST_TICKS_PER_US, st.Latency / HOST_TICKS_PER_US);
+	if (CheckBuf)
+		printf("data mismatches: %u\n", st.Mismatches);
+	else
+		printf("data mismatches: not checked (compressed image, see -c)\n");
+	if (CheckFd >= 0)
+		close(CheckFd);
+	free(CheckFiles);
+	free(CheckBuf);
+	free(rec);
+	return st.Mismatches ? 1 : 0;
+}
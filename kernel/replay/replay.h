@@ -0,0 +1,58 @@
+// Nintendont (kernel): host replay build.
+// Interface between the replay driver and the hardware/FatFS shim.
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+// HW_TIMER rate: one tick every 526.7 ns.
+#define HOST_TICKS_PER_US	1.8986
+
+// Emulated memory, identity mapped.
+#define HOST_LOWMEM_SIZE	0x10000		// page 0, redirected to a buffer
+#define HOST_MEM1_START		0x00010000
+#define HOST_MEM1_END		0x01800000
+#define HOST_MEM2_START		0x10000000
+#define HOST_MEM2_END		0x14000000
+#define HOST_ARENA_START	0x14000000	// malloc() arena
+#define HOST_ARENA_END		0x15000000
+
+// Backing store counters.
+typedef struct _HostIOStats
+{
+	unsigned long long Bytes;	// bytes read from image files
+	unsigned int Reads;		// f_read() calls that hit the image
+	unsigned int Seeks;		// reads that did not continue the previous one
+} HostIOStats;
+
+extern HostIOStats HostIO;
+
+// Emulated HW_TIMER.
+extern unsigned int HostTicks;
+
+// Backing store model: cost of a seek, and of each byte read.
+extern unsigned int HostSeekTicks;
+extern double HostByteTicks;
+
+// Host file to open for /saves/<ID6>.trace, or NULL.
+extern const char *HostTracePath;
+
+// Clusters per image file fragment on the emulated volume, 0 for one piece.
+extern unsigned int HostFragClusters;
+
+// Print kernel debug output.
+extern int HostVerbose;
+
+/**
+ * Map the emulated MEM1, MEM2 and malloc() arena.
+ * @return 0 on success; -1 on error.
+ */
+int HostMemInit(void);
+
+/**
+ * Translate an emulated address to a host pointer.
+ * @param addr Emulated address.
+ * @return Host pointer.
+ */
+void *HostPtr(unsigned int addr);
+
+#endif /* __REPLAY_H__ */
@@ -0,0 +1,219 @@
+// Nintendont (kernel): host 48 kHz to 32 kHz resampler check.
+// Compares Resample48to32() against the original drop-and-average
+// loop: distortion on tones inside the 32 kHz band, rejection of tones
+// that alias into it, and speed.
+//
+//   make -C kernel/replay resbench
+//   kernel/replay/resbench [blocks]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Resample.h"
+
+#define SAMPLES_PER_BLOCK	28
+#define TONE_BLOCKS		672	// one 48 kHz stream chunk
+#define TONE_SKIP		64	// output frames left out while the filter fills
+
+// The original resampler: of every 3 frames, keep the first and
+// average the other two.
+static unsigned int RefCounter;
+static short RefSavedL, RefSavedR;
+
+static void RefReset(void)
+{
+	RefCounter = 0;
+	RefSavedL = RefSavedR = 0;
+}
+
+static unsigned int RefResample(short *pcm, short *out)
+{
+	unsigned int j, count = 0;
+	for (j = 0; j < SAMPLES_PER_BLOCK; j++)
+	{
+		RefCounter++;
+		if (RefCounter == 2)
+		{
+			RefSavedL = pcm[j * 2];
+			RefSavedR = pcm[j * 2 + 1];
+			continue;
+		}
+		if (RefCounter == 3)
+		{
+			pcm[j * 2] = (pcm[j * 2] + RefSavedL) >> 1;
+			pcm[j * 2 + 1] = (pcm[j * 2 + 1] + RefSavedR) >> 1;
+			RefCounter = 0;
+		}
+		out[count * 2] = pcm[j * 2];
+		out[count * 2 + 1] = pcm[j * 2 + 1];
+		count++;
+	}
+	return count;
+}
+
+// Stereo tone at 48 kHz, the right channel a quarter period behind.
+static void Tone(short *in, unsigned int frames, double hz, double amp)
+{
+	unsigned int i;
+	for (i = 0; i < frames; i++)
+	{
+		double w = 2 * M_PI * hz * i / 48000;
+		in[i * 2] = (short)lrint(amp * 32767 * sin(w));
+		in[i * 2 + 1] = (short)lrint(amp * 32767 * cos(w));
+	}
+}
+
+// Run a whole input through one of the resamplers, a block at a time.
+static unsigned int Run(int ref, Resampler *r, const short *in, unsigned int blocks, short *out)
+{
+	short pcm[SAMPLES_PER_BLOCK * 2];
+	unsigned int i, count = 0;
+
+	if (ref)
+		RefReset();
+	else
+		ResampleReset(r);
+	// The copy stands in for the ADP decoder writing its output.
+	for (i = 0; i < blocks; i++)
+	{
+		if (ref)
+		{
+			memcpy(pcm, in + i * SAMPLES_PER_BLOCK * 2, sizeof(pcm));
+			count += RefResample(pcm, out + count * 2);
+		}
+		else
+		{
+			memcpy(ResampleInput(r), in + i * SAMPLES_PER_BLOCK * 2, sizeof(pcm));
+			count += Resample48to32(r, SAMPLES_PER_BLOCK, out + count * 2);
+		}
+	}
+	return count;
+}
+
+// Fit a sine at hz to the left channel; return the signal power and
+// the power of everything else.
+static void Fit(const short *out, unsigned int frames, double hz, double *sig, double *rest)
+{
+	double ss = 0, cc = 0, sc = 0, xs = 0, xc = 0, a, b, det;
+	unsigned int i, n = 0;
+
+	for (i = TONE_SKIP; i < frames; i++)
+	{
+		double w = 2 * M_PI * hz * i / 32000;
+		double s = sin(w), c = cos(w), x = out[i * 2];
+		ss += s * s; cc += c * c; sc += s * c;
+		xs += x * s; xc += x * c;
+	}
+	det = ss * cc - sc * sc;
+	a = (xs * cc - xc * sc) / det;
+	b = (xc * ss - xs * sc) / det;
+
+	*sig = *rest = 0;
+	for (i = TONE_SKIP; i < frames; i++)
+	{
+		double w = 2 * M_PI * hz * i / 32000;
+		double f = a * sin(w) + b * cos(w), x = out[i * 2];
+		*sig += f * f;
+		*rest += (x - f) * (x - f);
+		n++;
+	}
+	*sig /= n;
+	*rest /= n;
+}
+
+static double Power(const short *out, unsigned int frames)
+{
+	double p = 0;
+	unsigned int i;
+	for (i = TONE_SKIP; i < frames; i++)
+		p += (double)out[i * 2] * out[i * 2];
+	return p / (frames - TONE_SKIP);
+}
+
+static double dB(double ratio)
+{
+	return 10 * log10(ratio);
+}
+
+static double Seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	static const double Band[] = { 100, 1000, 5000, 10000, 12000, 14000 };
+	static const double Alias[] = { 18000, 20000, 22000 };
+	unsigned int blocks = 0x10000;
+	unsigned int frames = TONE_BLOCKS * SAMPLES_PER_BLOCK;
+	unsigned int i, n, bad = 0;
+	Resampler r;
+	short *in, *out;
+	double t, sig, rest, inpow;
+	int sink = 0;
+
+	if (argc > 1)
+		blocks = strtoul(argv[1], NULL, 0);
+	if (blocks < TONE_BLOCKS)
+		blocks = TONE_BLOCKS;
+	in = malloc(blocks * SAMPLES_PER_BLOCK * 4);
+	out = malloc(blocks * SAMPLES_PER_BLOCK * 4);
+	if (!in || !out)
+		return 1;
+	memset(in, 0, blocks * SAMPLES_PER_BLOCK * 4);
+
+	// A chunk has to fill the output buffer exactly.
+	n = Run(0, &r, in, TONE_BLOCKS, out);
+	printf("chunk:    %u frames (%s)\n", n, n == frames * 2 / 3 ? "ok" : "FAIL");
+	if (n != frames * 2 / 3)
+		bad++;
+
+	// Tones the 32 kHz output can carry: gain and signal to
+	// noise and distortion.
+	printf("tone       original        polyphase\n");
+	for (i = 0; i < sizeof(Band) / sizeof(Band[0]); i++)
+	{
+		Tone(in, frames, Band[i], 0.5);
+		inpow = 0.5 * 0.5 * 32767.0 * 32767.0 / 2;
+		n = Run(1, &r, in, TONE_BLOCKS, out);
+		Fit(out, n, Band[i], &sig, &rest);
+		printf("%5.0f Hz  %+5.1f dB %5.1f dB", Band[i], dB(sig / inpow), dB(sig / rest));
+		n = Run(0, &r, in, TONE_BLOCKS, out);
+		Fit(out, n, Band[i], &sig, &rest);
+		printf("  %+5.1f dB %5.1f dB\n", dB(sig / inpow), dB(sig / rest));
+	}
+
+	// Tones above 16 kHz: all the output is alias.
+	for (i = 0; i < sizeof(Alias) / sizeof(Alias[0]); i++)
+	{
+		Tone(in, frames, Alias[i], 0.5);
+		inpow = 0.5 * 0.5 * 32767.0 * 32767.0 / 2;
+		n = Run(1, &r, in, TONE_BLOCKS, out);
+		printf("%5.0f Hz  alias %5.1f dB", Alias[i], dB(Power(out, n) / inpow));
+		n = Run(0, &r, in, TONE_BLOCKS, out);
+		printf("     alias %5.1f dB\n", dB(Power(out, n) / inpow));
+	}
+
+	// Speed, on a long stream.
+	Tone(in, blocks * SAMPLES_PER_BLOCK, 1000, 0.5);
+	t = Seconds();
+	n = Run(1, &r, in, blocks, out);
+	t = Seconds() - t;
+	sink += out[0];
+	printf("original: %6.2f ns/frame out\n", t * 1e9 / n);
+
+	t = Seconds();
+	n = Run(0, &r, in, blocks, out);
+	t = Seconds() - t;
+	sink += out[0];
+	printf("polyph.:  %6.2f ns/frame out\n", t * 1e9 / n);
+
+	free(in);
+	free(out);
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+// Nintendont (kernel): host replay build.
+// Emulated memory, HW_TIMER and a POSIX-backed FatFS for the kernel's
+// disc readers. File reads advance HW_TIMER by the backing store model.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ff.h"
+#include "ff_utf8.h"
+#include "diskio.h"
+#include "replay.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE	0x100000
+#endif
+
+#define HOST_HW_TIMER	0x0D800010
+
+// Emulated volume: 512 byte sectors, 32 KB clusters.
+#define HOST_SECTOR_SIZE	512
+#define HOST_CLUSTER_SECTORS	64
+#define HOST_DATABASE		0x800
+
+HostIOStats HostIO;
+unsigned int HostTicks = 0;
+unsigned int HostSeekTicks = 0;
+double HostByteTicks = 0;
+const char *HostTracePath = NULL;
+unsigned int HostFragClusters = 0;
+int HostVerbose = 0;
+
+static unsigned char LowMem[HOST_LOWMEM_SIZE];
+static uintptr_t ArenaPos = HOST_ARENA_START;
+
+// Last file read, for seek accounting.
+static int LastFd = -1;
+static FSIZE_t LastEnd = 0;
+static DWORD LastSector = ~0UL;
+
+// The volume, and the file whose link map was created.
+static FATFS HostFs;
+static int MapFd = -1;
+static unsigned int MapFrag;	// clusters per fragment
+static unsigned int MapFrags;
+
+/** Memory **/
+
+static int HostMap(uintptr_t start, uintptr_t end)
+{
+	void *p = mmap((void*)start, end - start, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE, -1, 0);
+	if (p != (void*)start)
+	{
+		fprintf(stderr, "replay: unable to map %08lX-%08lX\n",
+			(unsigned long)start, (unsigned long)end);
+		return -1;
+	}
+	return 0;
+}
+
+int HostMemInit(void)
+{
+	if (HostMap(HOST_MEM1_START, HOST_MEM1_END) ||
+	    HostMap(HOST_MEM2_START, HOST_MEM2_END) ||
+	    HostMap(HOST_ARENA_START, HOST_ARENA_END))
+		return -1;
+	return 0;
+}
+
+static inline void *HostAddr(uintptr_t addr)
+{
+	if (addr < HOST_LOWMEM_SIZE)
+		return &LowMem[addr];
+	return (void*)addr;
+}
+
+void *HostPtr(unsigned int addr)
+{
+	return HostAddr(addr);
+}
+
+void *HostMemcpy(void *dst, const void *src, size_t size)
+{
+	memmove(HostAddr((uintptr_t)dst), HostAddr((uintptr_t)src), size);
+	return dst;
+}
+
+void *HostMemset(void *dst, int x, size_t n)
+{
+	memset(HostAddr((uintptr_t)dst), x, n);
+	return dst;
+}
+
+void *HostMemset32(void *dst, int x, size_t len)
+{
+	memset(HostAddr((uintptr_t)dst), x, len);
+	return dst;
+}
+
+void *HostMalloca(unsigned int size, unsigned int align)
+{
+	uintptr_t p = (ArenaPos + align - 1) & ~(uintptr_t)(align - 1);
+	if (p + size > HOST_ARENA_END)
+	{
+		fprintf(stderr, "replay: out of kernel heap\n");
+		exit(1);
+	}
+	ArenaPos = p + size;
+	return (void*)p;
+}
+
+void *HostMalloc(unsigned int size)
+{
+	return HostMalloca(size, 32);
+}
+
+void HostFree(void *ptr)
+{
+	// Bump allocator; the kernel only frees at close.
+	(void)ptr;
+}
+
+/** Hardware **/
+
+// Memory is seen in console (big-endian) byte order.
+unsigned int read32(unsigned int addr)
+{
+	if (addr == HOST_HW_TIMER)
+		return HostTicks;
+	const unsigned char *p = HostAddr(addr);
+	return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void write32(unsigned int addr, unsigned int data)
+{
+	unsigned char *p = HostAddr(addr);
+	p[0] = data >> 24;
+	p[1] = data >> 16;
+	p[2] = data >> 8;
+	p[3] = data;
+}
+
+unsigned short read16(unsigned int addr)
+{
+	const unsigned char *p = HostAddr(addr);
+	return (p[0] << 8) | p[1];
+}
+
+void write16(unsigned int addr, unsigned short data)
+{
+	unsigned char *p = HostAddr(addr);
+	p[0] = data >> 8;
+	p[1] = data;
+}
+
+unsigned int set32(unsigned int addr, unsigned int set)
+{
+	unsigned int data = read32(addr) | set;
+	write32(addr, data);
+	return data;
+}
+
+unsigned int mask32(unsigned int addr, unsigned int clear, unsigned int set)
+{
+	unsigned int data = (read32(addr) & ~clear) | set;
+	write32(addr, data);
+	return data;
+}
+
+unsigned int clear32(unsigned int addr, unsigned int clear)
+{
+	unsigned int data = read32(addr) & ~clear;
+	write32(addr, data);
+	return data;
+}
+
+void sync_before_read(void *ptr, int len) { (void)ptr; (void)len; }
+void sync_after_write(void *ptr, int len) { (void)ptr; (void)len; }
+void udelay(int us) { HostTicks += us * HOST_TICKS_PER_US; }
+
+void Shutdown(void)
+{
+	fprintf(stderr, "replay: kernel shutdown\n");
+	exit(1);
+}
+
+void Asciify(char *str)
+{
+	for (; *str != 0; str++)
+	{
+		if (!isprint((unsigned char)*str))
+			*str = '_';
+	}
+}
+
+int dbgprintf(const char *fmt, ...)
+{
+	if (!HostVerbose)
+		return 0;
+	va_list args;
+	va_start(args, fmt);
+	int ret = vfprintf(stderr, fmt, args);
+	va_end(args);
+	return ret;
+}
+
+int _sprintf(char *buf, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int ret = vsprintf(buf, fmt, args);
+	va_end(args);
+	return ret;
+}
+
+/** FatFS **/
+
+static inline int HostFd(const FIL *fp)
+{
+	return (int)fp->obj.sclust - 1;
+}
+
+FRESULT f_open_char(FIL *fp, const char *path, BYTE mode)
+{
+	struct stat st;
+	int fd;
+
+	memset(fp, 0, sizeof(*fp));
+	if (!strncmp(path, "/saves/", 7))
+	{
+		// Only the trace used for preloading is available.
+		if (HostTracePath == NULL || (mode & FA_WRITE))
+			return FR_NO_FILE;
+		path = HostTracePath;
+	}
+	if (mode & FA_WRITE)
+		fd = open(path, O_RDWR | ((mode & FA_CREATE_ALWAYS) ? O_CREAT|O_TRUNC : 0), 0644);
+	else
+		fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return FR_NO_FILE;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		close(fd);
+		return FR_NO_FILE;
+	}
+
+	fp->obj.fs = &HostFs;
+	fp->obj.sclust = fd + 1;
+	fp->obj.objsize = st.st_size;
+	fp->flag = mode;
+	return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+	if (fp->obj.sclust == 0)
+		return FR_INVALID_OBJECT;
+	if (HostFd(fp) == LastFd)
+		LastFd = -1;
+	if (HostFd(fp) == MapFd)
+		MapFd = -1;
+	close(HostFd(fp));
+	fp->obj.sclust = 0;
+	return FR_OK;
+}
+
+/**
+ * Physical fragment of a file fragment.
+ * Neighbouring fragments swap places, so each one needs a seek.
+ */
+static inline unsigned int HostFragSlot(unsigned int frag)
+{
+	return ((frag ^ 1) < MapFrags) ? (frag ^ 1) : frag;
+}
+
+/**
+ * Lay the file out on the emulated volume and create its link map.
+ * The file is split into -F sized fragments; unsplit by default.
+ */
+static FRESULT HostLinkMap(FIL *fp)
+{
+	const unsigned int ClusterSize = HOST_SECTOR_SIZE * HOST_CLUSTER_SECTORS;
+	const unsigned int Clusters = (fp->obj.objsize + ClusterSize - 1) / ClusterSize;
+	unsigned int i;
+	DWORD *tbl = fp->cltbl;
+
+	HostFs.csize = HOST_CLUSTER_SECTORS;
+#if _MAX_SS != _MIN_SS
+	HostFs.ssize = HOST_SECTOR_SIZE;
+#endif
+	HostFs.database = HOST_DATABASE;
+	HostFs.drv = 0;
+
+	MapFrag = (HostFragClusters && HostFragClusters < Clusters) ? HostFragClusters : Clusters;
+	if (MapFrag == 0)
+		MapFrag = 1;
+	MapFrags = (Clusters + MapFrag - 1) / MapFrag;
+	if (tbl[0] < MapFrags * 2 + 2)
+	{
+		tbl[0] = MapFrags * 2 + 2;
+		return FR_NOT_ENOUGH_CORE;
+	}
+	for (i = 0; i < MapFrags; i++)
+	{
+		unsigned int Len = Clusters - i * MapFrag;
+		if (Len > MapFrag)
+			Len = MapFrag;
+		tbl[1 + i*2] = Len;
+		tbl[2 + i*2] = 2 + HostFragSlot(i) * MapFrag;
+	}
+	tbl[1 + MapFrags*2] = 0;
+	MapFd = HostFd(fp);
+	return FR_OK;
+}
+
+/**
+ * Raw sector reads from the file with a link map.
+ */
+static DRESULT HostDiskRead(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	unsigned char *dst = HostAddr((uintptr_t)buff);
+	(void)pdrv;
+	if (MapFd < 0 || sector < HOST_DATABASE)
+		return RES_PARERR;
+
+	if (sector != LastSector)
+	{
+		HostIO.Seeks++;
+		HostTicks += HostSeekTicks;
+	}
+	LastSector = sector + count;
+	HostTicks += (unsigned int)((double)count * HOST_SECTOR_SIZE * HostByteTicks);
+	HostIO.Reads++;
+	HostIO.Bytes += (unsigned long long)count * HOST_SECTOR_SIZE;
+
+	while (count > 0)
+	{
+		const unsigned int Rel = (sector - HOST_DATABASE) / HOST_CLUSTER_SECTORS;
+		const unsigned int Frag = HostFragSlot(Rel / MapFrag);
+		const unsigned long long Cluster = (unsigned long long)Frag * MapFrag + Rel % MapFrag;
+		const unsigned long long Pos = Cluster * HOST_CLUSTER_SECTORS * HOST_SECTOR_SIZE +
+			(unsigned long long)((sector - HOST_DATABASE) % HOST_CLUSTER_SECTORS) * HOST_SECTOR_SIZE;
+		// Stay within the cluster, the next one may be elsewhere.
+		unsigned int n = HOST_CLUSTER_SECTORS - (sector - HOST_DATABASE) % HOST_CLUSTER_SECTORS;
+		if (n > count)
+			n = count;
+		ssize_t ret = pread(MapFd, dst, n * HOST_SECTOR_SIZE, Pos);
+		if (ret < 0)
+			return RES_ERROR;
+		if (ret < (ssize_t)(n * HOST_SECTOR_SIZE))
+			memset(dst + ret, 0, n * HOST_SECTOR_SIZE - ret);
+		dst += n * HOST_SECTOR_SIZE;
+		sector += n;
+		count -= n;
+	}
+	return RES_OK;
+}
+
+DiskReadFunc disk_read = HostDiskRead;
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+	if (fp->obj.sclust == 0)
+		return FR_INVALID_OBJECT;
+	if (ofs == CREATE_LINKMAP)
+		return HostLinkMap(fp);
+	fp->fptr = ofs;
+	return FR_OK;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+	ssize_t ret;
+
+	*br = 0;
+	if (fp->obj.sclust == 0)
+		return FR_INVALID_OBJECT;
+	if (fp->fptr >= fp->obj.objsize)
+		return FR_OK;
+	if (btr > fp->obj.objsize - fp->fptr)
+		btr = fp->obj.objsize - fp->fptr;
+
+	ret = pread(HostFd(fp), HostAddr((uintptr_t)buff), btr, fp->fptr);
+	if (ret < 0)
+		return FR_DISK_ERR;
+
+	// Backing store model.
+	if (HostFd(fp) != LastFd || fp->fptr != LastEnd)
+	{
+		HostIO.Seeks++;
+		HostTicks += HostSeekTicks;
+	}
+	HostTicks += (unsigned int)(ret * HostByteTicks);
+	HostIO.Reads++;
+	HostIO.Bytes += ret;
+
+	fp->fptr += ret;
+	LastFd = HostFd(fp);
+	LastEnd = fp->fptr;
+	*br = ret;
+	return FR_OK;
+}
+
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+	ssize_t ret;
+
+	*bw = 0;
+	if (fp->obj.sclust == 0 || !(fp->flag & FA_WRITE))
+		return FR_DENIED;
+	ret = pwrite(HostFd(fp), HostAddr((uintptr_t)buff), btw, fp->fptr);
+	if (ret < 0)
+		return FR_DISK_ERR;
+	fp->fptr += ret;
+	*bw = ret;
+	return FR_OK;
+}
+
+FRESULT f_mkdir_char(const char *path)
+{
+	(void)path;
+	return FR_OK;
+}
@@ -18,6 +18,7 @@ char *strchr(const char *s, int c);
 int memcmp(const void *s1, const void *s2, size_t n);
 void *memset(void *dst, int x, size_t n);
 extern void *memcpy( void *dst, const void *src, size_t size);
+void *memmove(void *dst, const void *src, size_t n);
 
 int _sprintf( char *buf, const char *fmt, ... );
 
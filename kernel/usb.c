@@ -156,6 +156,27 @@ s32 USB_WriteBlkMsg(s32 fd,u8 bEndpoint,u16 wLength,void *rpData)
 	return __usb_interrupt_bulk_message(fd,USBV5_IOCTL_BULKMSG,bEndpoint,wLength,rpData);
 }
 
+s32 USB_ReadBlkMsgAsync(s32 fd,u8 bEndpoint,u16 wLength,void *rpData,struct _usb_msg *msg,s32 queue,struct ipcmessage *ipcmsg)
+{
+	if(((s32)rpData%32)!=0) return IPC_EINVAL;
+	if(wLength && !rpData) return IPC_EINVAL;
+	if(!wLength && rpData) return IPC_EINVAL;
+
+	msg->fd = fd;
+
+	msg->bulk.rpData = rpData;
+	msg->bulk.wLength = wLength;
+	msg->bulk.bEndpoint = bEndpoint;
+
+	msg->vec[0].data = msg;
+	msg->vec[0].len = 64;
+	msg->vec[1].data = rpData;
+	msg->vec[1].len = wLength;
+
+	//msg has to stay valid until the reply arrives on queue
+	return IOS_IoctlvAsync(ven_fd, USBV5_IOCTL_BULKMSG, 1, 1, msg->vec, queue, ipcmsg);
+}
+
 s32 USB_ReadCtrlMsg(s32 fd,u8 bmRequestType,u8 bmRequest,u16 wValue,u16 wIndex,u16 wLength,void *rpData)
 {
 	return __usb_control_message(fd,bmRequestType,bmRequest,wValue,wIndex,wLength,rpData);
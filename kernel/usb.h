@@ -144,11 +144,14 @@ struct _usb_msg {
 	ioctlv vec[7];
 };
 
+struct ipcmessage;
+
 s32 USB_Initialize();
 s32 USB_Deinitialize();
 
 s32 USB_ReadIntrMsg(s32 fd,u8 bEndpoint,u16 wLength,void *rpData);
 s32 USB_ReadBlkMsg(s32 fd,u8 bEndpoint,u16 wLength,void *rpData);
+s32 USB_ReadBlkMsgAsync(s32 fd,u8 bEndpoint,u16 wLength,void *rpData,struct _usb_msg *msg,s32 queue,struct ipcmessage *ipcmsg);
 s32 USB_ReadCtrlMsg(s32 fd,u8 bmRequestType,u8 bmRequest,u16 wValue,u16 wIndex,u16 wLength,void *rpData);
 
 s32 USB_WriteIntrMsg(s32 fd,u8 bEndpoint,u16 wLength,void *rpData);
@@ -78,6 +78,19 @@ distribution.
 #define INVALID_LUN					-2
 
 #define MAX_TRANSFER_SIZE_V5		(16*1024)
+#define MAX_TRANSFER_SIZE_LARGE		(60*1024)	// largest 4KB multiple that fits wLength
+
+// Pipelined reads: bulk-in transfers kept queued on the endpoint,
+// and the bounce buffer slice each one uses for non-MEM2 buffers.
+#define PIPE_DEPTH					2
+#define PIPE_BOUNCE_SIZE			(32*1024)
+// A pipelined read with nothing completing for this long has timed out;
+// the watchdog message carries the low bits of the command's tag.
+#define PIPE_TIMEOUT				(2*1000*1000)	// us
+#define PIPE_TIMEOUT_MSG			0xBA000000
+
+// Largest single READ_10; longer reads are split.
+#define MAX_READ_SIZE				(1024*1024)
 
 #define DEVLIST_MAXSIZE				8
 
@@ -98,6 +111,13 @@ static s32 __usb_fd = -1;
 static u8 *cbw_buffer = NULL;
 static u8 *transferbuffer = NULL;
 
+static u32 __max_transfer = MAX_TRANSFER_SIZE_LARGE;
+static bool __pipe_disabled = false;
+static s32 __pipe_queue = -1;
+static u8 *__pipe_heap = NULL;
+static struct _usb_msg *__pipe_req[PIPE_DEPTH+1];
+static struct ipcmessage *__pipe_ipc[PIPE_DEPTH+1];
+
 static s32 __usbstorage_reset();
 
 static s32 __send_cbw(u8 lun, u32 len, u8 flags, const u8 *cb, u8 cbLen)
@@ -124,15 +144,10 @@ static s32 __send_cbw(u8 lun, u32 len, u8 flags, const u8 *cb, u8 cbLen)
 	return retval;
 }
 
-static s32 __read_csw(u8 *status, u32 *dataResidue)
+static s32 __parse_csw(u8 *status, u32 *dataResidue)
 {
-	s32 retval = USBSTORAGE_OK;
 	u32 signature, tag, _dataResidue, _status;
 
-	retval = USB_WriteBlkMsg(__usb_fd, __ep_in, CSW_SIZE, cbw_buffer);
-	if(retval > 0 && retval != CSW_SIZE) return USBSTORAGE_ESHORTREAD;
-	else if(retval < 0) return retval;
-
 	signature = bswap32(read32(((u32)cbw_buffer)));
 	tag = bswap32(read32(((u32)cbw_buffer)+4));
 	_dataResidue = bswap32(read32(((u32)cbw_buffer)+8));
@@ -150,6 +165,17 @@ static s32 __read_csw(u8 *status, u32 *dataResidue)
 	return USBSTORAGE_OK;
 }
 
+static s32 __read_csw(u8 *status, u32 *dataResidue)
+{
+	s32 retval = USBSTORAGE_OK;
+
+	retval = USB_WriteBlkMsg(__usb_fd, __ep_in, CSW_SIZE, cbw_buffer);
+	if(retval > 0 && retval != CSW_SIZE) return USBSTORAGE_ESHORTREAD;
+	else if(retval < 0) return retval;
+
+	return __parse_csw(status, dataResidue);
+}
+
 static s32 __cycle(u8 lun, u8 *buffer, u32 len, u8 *cb, u8 cbLen, u8 write, u8 *_status, u32 *_dataResidue)
 {
 	s32 retval = USBSTORAGE_OK;
@@ -209,6 +235,123 @@ static s32 __cycle(u8 lun, u8 *buffer, u32 len, u8 *cb, u8 cbLen, u8 write, u8 *
 	return retval;
 }
 
+/**
+ * Bulk-only read with a pipelined data phase.
+ * Up to PIPE_DEPTH bulk-in transfers stay queued on the endpoint and the
+ * CSW read is queued right behind the last one, so the device never waits
+ * for the next request. Bulk-only transport allows a single command in
+ * flight, so the overlap is within the command, not across commands.
+ * A watchdog timer stops it waiting forever on a transfer that never
+ * completes: the device is reset to cancel what is in flight and
+ * USBSTORAGE_ETIMEDOUT is returned. Other errors get no reset or retry
+ * here; the caller falls back to __cycle().
+ * @param lun LUN.
+ * @param buffer Destination buffer.
+ * @param len Length of the data phase, in bytes.
+ * @param cb Command block.
+ * @param cbLen Command block length.
+ * @param _status Receives the CSW status.
+ * @return USBSTORAGE_OK on success; negative on error.
+ */
+static s32 __read_pipelined(u8 lun, u8 *buffer, u32 len, u8 *cb, u8 cbLen, u8 *_status)
+{
+	struct ipcmessage *msg = NULL;
+	u8 *slotDst[PIPE_DEPTH];
+	u32 slotLen[PIPE_DEPTH];
+	u32 slotFree = (1 << PIPE_DEPTH) - 1;
+	u32 issued = 0, pending = 0, i;
+	bool bounce = ((u32)buffer&0x1F) || !((u32)buffer&0x10000000);
+	bool cswQueued = false;
+	u32 chunk = __max_transfer;
+	s32 csw = USBSTORAGE_ESHORTREAD;
+	s32 timer;
+	s32 result;
+	s32 retval;
+
+	if(bounce && chunk > PIPE_BOUNCE_SIZE)
+		chunk = PIPE_BOUNCE_SIZE;
+
+	retval = __send_cbw(lun, len, CBW_IN, cb, cbLen);
+	if(retval < 0)
+		return retval;
+	timer = TimerCreate(PIPE_TIMEOUT, 0, __pipe_queue, PIPE_TIMEOUT_MSG | (__tag & 0xFFFFFF));
+
+	while(1)
+	{
+		//keep every slot busy while there is data left
+		while(retval >= 0 && issued < len && slotFree != 0)
+		{
+			u32 thisLen = (len - issued) > chunk ? chunk : (len - issued);
+			for(i = 0; (slotFree & (1 << i)) == 0; ++i) ;
+
+			slotDst[i] = buffer + issued;
+			slotLen[i] = thisLen;
+			retval = USB_ReadBlkMsgAsync(__usb_fd, __ep_in, thisLen,
+						bounce ? transferbuffer + i * PIPE_BOUNCE_SIZE : slotDst[i],
+						__pipe_req[i], __pipe_queue, __pipe_ipc[i]);
+			if(retval < 0)
+				break;
+			slotFree &= ~(1 << i);
+			issued += thisLen;
+			pending++;
+		}
+		//all data requested, have the status follow immediately
+		if(retval >= 0 && issued == len && !cswQueued)
+		{
+			retval = USB_ReadBlkMsgAsync(__usb_fd, __ep_in, CSW_SIZE, cbw_buffer,
+						__pipe_req[PIPE_DEPTH], __pipe_queue, __pipe_ipc[PIPE_DEPTH]);
+			if(retval >= 0)
+			{
+				cswQueued = true;
+				pending++;
+			}
+		}
+		if(pending == 0)
+			break;
+
+		//on error nothing new is queued, just drain what is in flight
+		mqueue_recv(__pipe_queue, &msg, 0);
+		if(((u32)msg & 0xFF000000) == PIPE_TIMEOUT_MSG)
+		{
+			//left over from an earlier command, or this one timed out
+			if(((u32)msg & 0xFFFFFF) == (__tag & 0xFFFFFF) && retval != USBSTORAGE_ETIMEDOUT)
+			{
+				retval = USBSTORAGE_ETIMEDOUT;
+				__usbstorage_reset();
+			}
+			continue;
+		}
+		result = msg->result;
+		pending--;
+
+		if(msg == __pipe_ipc[PIPE_DEPTH])
+		{
+			csw = result;
+			continue;
+		}
+		for(i = 0; i < PIPE_DEPTH - 1 && msg != __pipe_ipc[i]; ++i) ;
+		slotFree |= 1 << i;
+
+		if(result != slotLen[i])
+		{
+			if(retval >= 0)
+				retval = result < 0 ? result : USBSTORAGE_EDATARESIDUE;
+		}
+		else if(bounce)
+			memcpy(slotDst[i], transferbuffer + i * PIPE_BOUNCE_SIZE, result);
+	}
+
+	if(timer >= 0)
+		TimerDestroy(timer);
+
+	if(retval < 0)
+		return retval;
+	if(csw != CSW_SIZE)
+		return csw < 0 ? csw : USBSTORAGE_ESHORTREAD;
+
+	return __parse_csw(_status, NULL);
+}
+
 static s32 __usbstorage_reset()
 {
 	s32 retval = USB_WriteCtrlMsg(__usb_fd, (USB_CTRLTYPE_DIR_HOST2DEVICE | USB_CTRLTYPE_TYPE_CLASS | USB_CTRLTYPE_REC_INTERFACE), USBSTORAGE_RESET, 0, __interface, 0, NULL);
@@ -252,8 +395,9 @@ void USBStorage_Open()
 	__ep_in = d->ep_in;
 	__ep_out = d->ep_out;
 
+	//__cycle() uses the first slice, pipelined reads one per slot
 	if(transferbuffer == NULL)
-		transferbuffer = (u8*)malloca(MAX_TRANSFER_SIZE_V5, 32);
+		transferbuffer = (u8*)malloca(PIPE_DEPTH * PIPE_BOUNCE_SIZE, 32);
 
 	__mounted = true;
 }
@@ -269,6 +413,19 @@ bool USBStorage_Startup(void)
 	if(cbw_buffer == NULL)
 		cbw_buffer = (u8*)malloca(32,32);
 
+	if(__pipe_queue < 0)
+	{
+		u32 i;
+		__pipe_heap = (u8*)malloca(32,32);
+		//room for an old and a new watchdog message too
+		__pipe_queue = mqueue_create(__pipe_heap, PIPE_DEPTH+3);
+		for(i = 0; i <= PIPE_DEPTH; ++i)
+		{
+			__pipe_req[i] = (struct _usb_msg*)malloca(sizeof(struct _usb_msg), 32);
+			__pipe_ipc[i] = (struct ipcmessage*)malloca(sizeof(struct ipcmessage), 32);
+		}
+	}
+
 	USBStorage_Open();
 
 	__inited = true;
@@ -280,26 +437,65 @@ bool USBStorage_ReadSectors(u32 sector, u32 numSectors, void *buffer)
 	if (!__mounted)
 		return false;
 
-	u8 status = 0;
-	s32 retval;
-	u8 cmd[] = {
-		SCSI_READ_10,
-		__lun << 5,
-		sector >> 24,
-		sector >> 16,
-		sector >>  8,
-		sector,
-		0,
-		numSectors >> 8,
-		numSectors,
-		0
-	};
+	u8 *_buffer = (u8*)buffer;
+	u32 maxSectors = MAX_READ_SIZE / s_size;
 
-	retval = __cycle(__lun, buffer, numSectors * s_size, cmd, sizeof(cmd), 0, &status, NULL);
-	if(retval > 0 && status != 0)
-		retval = USBSTORAGE_ESTATUS;
+	while(numSectors > 0)
+	{
+		u32 count = numSectors > maxSectors ? maxSectors : numSectors;
+		u8 status = 0;
+		s32 retval;
+		u8 cmd[] = {
+			SCSI_READ_10,
+			__lun << 5,
+			sector >> 24,
+			sector >> 16,
+			sector >>  8,
+			sector,
+			0,
+			count >> 8,
+			count,
+			0
+		};
+
+		if(__pipe_disabled)
+			retval = __cycle(__lun, _buffer, count * s_size, cmd, sizeof(cmd), 0, &status, NULL);
+		else
+		{
+			retval = __read_pipelined(__lun, _buffer, count * s_size, cmd, sizeof(cmd), &status);
+			if(retval < 0)
+			{
+				//some devices stall on large transfers, try the safe size first,
+				//then stop pipelining for good so every read doesn't pay a reset
+				if(retval == USBSTORAGE_ETIMEDOUT || __max_transfer == MAX_TRANSFER_SIZE_V5)
+				{
+					dbgprintf("USB:Pipelined read failed (%d), pipelining disabled\r\n", retval);
+					__pipe_disabled = true;
+				}
+				else
+				{
+					dbgprintf("USB:Pipelined read failed (%d), using %u byte transfers\r\n", retval, MAX_TRANSFER_SIZE_V5);
+					__max_transfer = MAX_TRANSFER_SIZE_V5;
+				}
+				//like __cycle, a timeout has had its reset and is not retried
+				if(retval != USBSTORAGE_ETIMEDOUT)
+				{
+					__usbstorage_reset();
+					retval = __cycle(__lun, _buffer, count * s_size, cmd, sizeof(cmd), 0, &status, NULL);
+				}
+			}
+		}
+		if(retval > 0 && status != 0)
+			retval = USBSTORAGE_ESTATUS;
+		if(retval < 0)
+			return false;
+
+		sector += count;
+		numSectors -= count;
+		_buffer += count * s_size;
+	}
 
-	return retval >= 0;
+	return true;
 }
 
 bool USBStorage_WriteSectors(u32 sector, u32 numSectors, const void *buffer)
@@ -359,5 +555,18 @@ void USBStorage_Shutdown(void)
 		free(cbw_buffer);
 		cbw_buffer = NULL;
 	}
+	if(__pipe_queue >= 0)
+	{
+		u32 i;
+		mqueue_destroy(__pipe_queue);
+		__pipe_queue = -1;
+		free(__pipe_heap);
+		__pipe_heap = NULL;
+		for(i = 0; i <= PIPE_DEPTH; ++i)
+		{
+			free(__pipe_req[i]);
+			free(__pipe_ipc[i]);
+		}
+	}
 	__inited = false;
 }
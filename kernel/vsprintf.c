@@ -15,6 +15,7 @@
 
 static FIL dbgfile;
 static int file_opened = -1;
+static bool file_dirty = false;
 vu32 SDisInit=0;
 
 extern int svc_write(char *buffer);
@@ -331,7 +332,7 @@ int dbgprintf( const char *fmt, ...)
 		if (file_opened == FR_OK) {
 			f_lseek(&dbgfile, dbgfile.obj.objsize);
 			f_write(&dbgfile, buffer, strlen(buffer), &read);
-			f_sync(&dbgfile);
+			file_dirty = true; //synced by LogFlush
 		}
 	}
 
@@ -342,6 +343,14 @@ int dbgprintf( const char *fmt, ...)
 
 	return 0;
 }
+bool LogFlush(void)
+{
+	if(file_opened != FR_OK || !file_dirty)
+		return false;
+	file_dirty = false;
+	f_sync(&dbgfile);
+	return true;
+}
 void closeLog(void)
 {
 	if(file_opened == FR_OK)
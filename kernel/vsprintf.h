@@ -8,5 +8,6 @@ int _vsprintf(char *buf, const char *fmt, va_list args);
 int _sprintf( char *buf, const char *fmt, ... );
 //int dbgprintf( const char *fmt, ...);
 void CheckOSReport(void);
+bool LogFlush(void);
 void closeLog(void);
 #endif
\ No newline at end of file
@@ -200,6 +200,18 @@ void FlushDevices(void);
  */
 bool IsSupportedFileExt(const char *filename);
 
+#include "ff.h"	/* for FIL */
+/**
+ * Read the start of a GCZ disc image.
+ * The first block is decompressed and the
+ * requested range is copied out of it.
+ * @param f	[in]  Opened disc image file.
+ * @param buf	[out] Output buffer.
+ * @param len	[in]  Number of bytes to read from disc offset 0.
+ * @return True on success; false if this isn't a usable GCZ image.
+ */
+bool GCZReadDiscStart(FIL *f, void *buf, u32 len);
+
 /**
  * Check if an ID6 is a known multi-game disc.
  * @param id6 ID6. (must be 6 bytes)
@@ -31,6 +31,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <ogc/wiilaunch.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "ff_utf8.h"
 #include "diskio.h"
@@ -642,7 +643,8 @@ bool IsSupportedFileExt(const char *filename)
 		const int extpos = len-3;
 		if (!strcasecmp(&filename[extpos], "gcm") ||
 		    !strcasecmp(&filename[extpos], "iso") ||
-		    !strcasecmp(&filename[extpos], "cso"))
+		    !strcasecmp(&filename[extpos], "cso") ||
+		    !strcasecmp(&filename[extpos], "gcz"))
 		{
 			// File extension is supported.
 			return true;
@@ -662,6 +664,88 @@ bool IsSupportedFileExt(const char *filename)
 	return false;
 }
 
+// GCZ: Dolphin compressed image. (little-endian)
+#define GCZ_MAGIC		0xB10BC001
+#define GCZ_HEADER_SIZE		0x20
+#define GCZ_BLOCK_SIZE_MAX	0x40000
+#define GCZ_STORED		(1ULL << 63)	// block is not compressed
+
+static inline u32 gcz_le32(const u8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static inline u64 gcz_le64(const u8 *p)
+{
+	return gcz_le32(p) | ((u64)gcz_le32(p + 4) << 32);
+}
+
+/**
+ * Read the start of a GCZ disc image.
+ * The first block is decompressed and the
+ * requested range is copied out of it.
+ * @param f	[in]  Opened disc image file.
+ * @param buf	[out] Output buffer.
+ * @param len	[in]  Number of bytes to read from disc offset 0.
+ * @return True on success; false if this isn't a usable GCZ image.
+ */
+bool GCZReadDiscStart(FIL *f, void *buf, u32 len)
+{
+	// Header plus the first two block pointers.
+	u8 hdr[GCZ_HEADER_SIZE + 16];
+	UINT read;
+	f_lseek(f, 0);
+	f_read(f, hdr, sizeof(hdr), &read);
+	if (read < GCZ_HEADER_SIZE + 8 || gcz_le32(hdr) != GCZ_MAGIC)
+		return false;
+
+	const u64 comp_size = gcz_le64(&hdr[0x08]);
+	const u32 block_size = gcz_le32(&hdr[0x18]);
+	const u32 num_blocks = gcz_le32(&hdr[0x1C]);
+	if (num_blocks == 0 || block_size < len || block_size > GCZ_BLOCK_SIZE_MAX)
+		return false;
+
+	const u64 ptr = gcz_le64(&hdr[0x20]);
+	const u64 start = ptr & ~GCZ_STORED;
+	const u64 end = (num_blocks > 1 && read == sizeof(hdr))
+			? (gcz_le64(&hdr[0x28]) & ~GCZ_STORED) : comp_size;
+	if (end < start || end - start > block_size)
+		return false;
+	const u32 size = (u32)(end - start);
+
+	// Block data comes after the pointers and the block hashes.
+	u8 *cbuf = malloc(size);
+	if (!cbuf)
+		return false;
+	f_lseek(f, GCZ_HEADER_SIZE + (u64)num_blocks * 12 + start);
+	f_read(f, cbuf, size, &read);
+	bool ret = false;
+	if (read == size)
+	{
+		if (ptr & GCZ_STORED)
+		{
+			if (size >= len)
+			{
+				memcpy(buf, cbuf, len);
+				ret = true;
+			}
+		}
+		else
+		{
+			u8 *out = malloc(block_size);
+			uLongf out_len = block_size;
+			if (out && uncompress(out, &out_len, cbuf, size) == Z_OK && out_len >= len)
+			{
+				memcpy(buf, out, len);
+				ret = true;
+			}
+			free(out);
+		}
+	}
+	free(cbuf);
+	return ret;
+}
+
 /**
  * Check if an ID6 is a known multi-game disc.
  * @param id6 ID6. (must be 6 bytes)
@@ -311,6 +311,19 @@ static u32 CheckForMultiGameAndRegion(unsigned int CurDICMD, u32 *ISOShift, u32
 			free(MultiHdr);
 			return ret;
 		}
+
+		if (!wiiVCInternal && GCZReadDiscStart(&f, MultiHdr, 0x800))
+		{
+			// GCZ image. GCZ+MultiGame is not supported either,
+			// and the BI2.bin region code is in the first block.
+			if (ISOShift)
+				*ISOShift = 0;
+			if (BI2region)
+				memcpy(BI2region, &MultiHdr[0x458], sizeof(*BI2region));
+			f_close(&f);
+			free(MultiHdr);
+			return 0;
+		}
 	}
 	else
 	{
@@ -67,7 +67,7 @@ const u32 DiscFormatColors[8] =
 	0x3366CCFF,	// CISO (blue)
 	0xCC66CCFF,	// Multi-Game (purple)
 	0xCCCC33FF,	// Oversized (yellow)
-	GRAY,		// undefined
+	0x33CCCCFF,	// GCZ (cyan)
 	GRAY,		// undefined
 };
 
@@ -140,6 +140,7 @@ static bool IsDiscImageValid(const char *filename, int discNumber, gameinfo *gi)
 	// TODO: Handle FST format (sys/boot.bin).
 	u8 buf[0x100];			// Disc header.
 	u32 BI2region_addr = 0x458;	// BI2 region code address.
+	u32 BI2region_gcz = 0;		// BI2 region code from the first GCZ block.
 
 	FIL in;
 	if (f_open_char(&in, filename, FA_READ|FA_OPEN_EXISTING) != FR_OK)
@@ -163,6 +164,7 @@ static bool IsDiscImageValid(const char *filename, int discNumber, gameinfo *gi)
 	// Check for CISO magic with 2 MB block size.
 	// NOTE: CISO block size is little-endian.
 	static const uint8_t CISO_MAGIC[8] = {'C','I','S','O',0x00,0x00,0x20,0x00};
+	static u8 gczbuf[0x460];
 	if (!memcmp(buf, CISO_MAGIC, sizeof(CISO_MAGIC)) &&
 	    !IsGCGame(buf))
 	{
@@ -183,6 +185,14 @@ static bool IsDiscImageValid(const char *filename, int discNumber, gameinfo *gi)
 
 		gi->Flags = GIFLAG_FORMAT_CISO;
 	}
+	else if (!IsGCGame(buf) && GCZReadDiscStart(&in, gczbuf, sizeof(gczbuf)))
+	{
+		// GCZ image. The disc header and the BI2 region
+		// code are both in the first block.
+		memcpy(buf, gczbuf, sizeof(buf));
+		memcpy(&BI2region_gcz, &gczbuf[0x458], sizeof(BI2region_gcz));
+		gi->Flags = GIFLAG_FORMAT_GCZ;
+	}
 	else
 	{
 		// Standard GameCube disc image.
@@ -208,13 +218,16 @@ static bool IsDiscImageValid(const char *filename, int discNumber, gameinfo *gi)
 	if (IsGCGame(buf))	// Must be GC game
 	{
 		// Read the BI2 region code.
-		u32 BI2region;
-		f_lseek(&in, BI2region_addr);
-		f_read(&in, &BI2region, sizeof(BI2region), &read);
-		if (read != sizeof(BI2region)) {
-			// Error reading from the file.
-			f_close(&in);
-			return false;
+		u32 BI2region = BI2region_gcz;
+		if ((gi->Flags & GIFLAG_FORMAT_MASK) != GIFLAG_FORMAT_GCZ)
+		{
+			f_lseek(&in, BI2region_addr);
+			f_read(&in, &BI2region, sizeof(BI2region), &read);
+			if (read != sizeof(BI2region)) {
+				// Error reading from the file.
+				f_close(&in);
+				return false;
+			}
 		}
 
 		// Save the region code for later.
@@ -232,9 +245,10 @@ static bool IsDiscImageValid(const char *filename, int discNumber, gameinfo *gi)
 		const bool is_multigame = IsMultiGameDisc((const char*)buf);
 		if (is_multigame)
 		{
-			if (gi->Flags == GIFLAG_FORMAT_CISO)
+			const u32 format = (gi->Flags & GIFLAG_FORMAT_MASK);
+			if (format == GIFLAG_FORMAT_CISO || format == GIFLAG_FORMAT_GCZ)
 			{
-				// Multi-game + CISO is NOT supported.
+				// Multi-game + CISO/GCZ is NOT supported.
 				ret = false;
 			}
 			else
@@ -383,6 +397,11 @@ static DevState LoadGameList(gameinfo *gi, u32 sz, u32 *pGameCount)
 		 * - /games/GAMEID/disc2.cso
 		 * - /games/[anything].ciso
 		 *
+		 * GCZ format:
+		 * - /games/GAMEID/game.gcz
+		 * - /games/GAMEID/disc2.gcz
+		 * - /games/[anything].gcz
+		 *
 		 * FST format:
 		 * - /games/GAMEID/sys/boot.bin plus other files
 		 *
@@ -410,15 +429,15 @@ static DevState LoadGameList(gameinfo *gi, u32 sz, u32 *pGameCount)
 			//Test if game.iso exists and add to list
 			bool found = false;
 
-			static const char disc_filenames[8][16] = {
-				"game.ciso", "game.cso", "game.gcm", "game.iso",
-				"disc2.ciso", "disc2.cso", "disc2.gcm", "disc2.iso"
+			static const char disc_filenames[10][16] = {
+				"game.ciso", "game.cso", "game.gcm", "game.iso", "game.gcz",
+				"disc2.ciso", "disc2.cso", "disc2.gcm", "disc2.iso", "disc2.gcz"
 			};
 
 			u32 i;
-			for (i = 0; i < 8; i++)
+			for (i = 0; i < 10; i++)
 			{
-				const u32 discNumber = i / 4;
+				const u32 discNumber = i / 5;
 
 				// Append the disc filename.
 				strcpy(&filename[fnlen], disc_filenames[i]);
@@ -430,7 +449,7 @@ static DevState LoadGameList(gameinfo *gi, u32 sz, u32 *pGameCount)
 					gamecount++;
 					found = true;
 					// Next disc number.
-					i = (discNumber * 4) + 3;
+					i = (discNumber * 5) + 4;
 				}
 			}
 
@@ -741,6 +760,7 @@ static bool UpdateGameSelectMenu(MenuCtx *ctx)
 		PrintFormat(DEFAULT_SIZE, DiscFormatColors[3], MENU_POS_X+(25*10), MENU_POS_Y + 20*3, "CISO");
 		PrintFormat(DEFAULT_SIZE, DiscFormatColors[4], MENU_POS_X+(30*10), MENU_POS_Y + 20*3, "Multi");
 		PrintFormat(DEFAULT_SIZE, DiscFormatColors[5], MENU_POS_X+(36*10), MENU_POS_Y + 20*3, "Over");
+		PrintFormat(DEFAULT_SIZE, DiscFormatColors[6], MENU_POS_X+(41*10), MENU_POS_Y + 20*3, "GCZ");
 
 		// Starting position.
 		int gamelist_y = MENU_POS_Y + 20*5 + 10;
@@ -1097,6 +1117,21 @@ static const char *const *GetSettingsDescription(const MenuCtx *ctx)
 				return desc_skip_netprof;
 			}
 
+			case 9: {
+				// DTK Loop Cache
+				static const char *desc_dtk_cache[] = {
+					"Keep short looping music",
+					"tracks decoded in memory",
+					"after the first time they",
+					"play, so later loops need",
+					"no disc reads.",
+					"",
+					"Uses 2 MB of the disc cache.",
+					NULL
+				};
+				return desc_dtk_cache;
+			}
+
 			default:
 				break;
 		}
@@ -1153,7 +1188,7 @@ static bool UpdateSettingsMenu(MenuCtx *ctx)
 
 		// Check for wraparound.
 		if ((ctx->settings.settingPart == 0 && ctx->settings.posX >= NIN_SETTINGS_LAST) ||
-		    (ctx->settings.settingPart == 1 && ctx->settings.posX >= 9))
+		    (ctx->settings.settingPart == 1 && ctx->settings.posX >= 10))
 		{
 			ctx->settings.posX = 0;
 			ctx->settings.settingPart ^= 1;
@@ -1180,7 +1215,7 @@ static bool UpdateSettingsMenu(MenuCtx *ctx)
 			if (ctx->settings.settingPart == 0) {
 				ctx->settings.posX = NIN_SETTINGS_LAST - 1;
 			} else {
-				ctx->settings.posX = 8;
+				ctx->settings.posX = 9;
 			}
 		}
 
@@ -1437,6 +1472,13 @@ static bool UpdateSettingsMenu(MenuCtx *ctx)
 					ctx->redraw = true;
 					break;
 
+				case 9:
+					// DTK Loop Cache
+					ctx->saveSettings = true;
+					ncfg->Config ^= (NIN_CFG_DTK_CACHE);
+					ctx->redraw = true;
+					break;
+
 				default:
 					break;
 			}
@@ -1629,6 +1671,11 @@ static bool UpdateSettingsMenu(MenuCtx *ctx)
 		}
 		ListLoopIndex++;
 
+		// DTK Loop Cache
+		PrintFormat(MENU_SIZE, WHITE, MENU_POS_X + 320, SettingY(ListLoopIndex),
+			    "%-18s:%-4s", "DTK Loop Cache", (ncfg->Config & (NIN_CFG_DTK_CACHE)) ? "On " : "Off");
+		ListLoopIndex++;
+
 		// Draw the cursor.
 		u32 cursor_color = WHITE;
 		if (ctx->settings.settingPart == 0) {